@@ -0,0 +1,356 @@
+/*
+ * 连接数扩展压测: 对 echo 服务建立大量(最多百万级)回环连接, 测量
+ * 1. 服务端每个连接的内存: 服务端RSS的增量 / 连接数, 以及内核 slab 的增量(包括客户端一侧的socket)
+ * 2. 所有连接都空闲时服务端的CPU占用, 即调度器和IO线程本身的开销
+ * 3. 其中一小部分连接活跃(ping-pong)时的吞吐量和延迟分位数
+ * 结果以一行JSON追加到 -o 指定的文件中
+ *
+ * 用法: 先运行 examples/echoserver -q [-b], 再运行
+ *       connbench -S 服务端pid [-a ip] [-p port] [-c 连接数] [-f 活跃比例] [-i 空闲秒数] [-d 活跃秒数] [-s 消息大小]
+ *                 [-r 源地址数] [-o 结果文件] [-n 名称]
+ *
+ * 百万连接需要:
+ * 1. 两端的 ulimit -n 大于连接数(本程序会尝试提高到硬限制), sysctl fs.nr_open / fs.file-max 足够大
+ * 2. 一个源地址到同一目的地址最多使用 net.ipv4.ip_local_port_range 范围内的端口(默认约2.8万个)
+ *    本程序轮流绑定 127.0.0.1 ~ 127.0.0.r 作为源地址(IP_BIND_ADDRESS_NO_PORT), 默认每2万个连接一个源地址
+ * 3. 服务端 listen 的 backlog 和 net.core.somaxconn 较小时建立连接较慢, 但不影响测量结果
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include <naku/naku.h>
+
+/* @brief 每个活跃连接的统计, 只由该连接的协程写入 */
+struct conn_stat
+{
+    std::vector<uint32_t> lat;  /* 每个请求的延迟(ns) */
+    uint64_t errors = 0;
+};
+
+static std::atomic<bool> stop(false);
+static std::atomic<int>  running(0);
+
+static inline uint64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* @brief 进程消耗的CPU时间(us), 读取 /proc/pid/stat 的 utime, stime */
+static double cpu_us(pid_t pid)
+{
+    char path[64];
+    unsigned long utime = 0, stime = 0;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    if (fscanf(fp, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return (utime + stime) * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+/* @brief 读取 file 中以 key 开头的一行的数值(kB), 用于 /proc/pid/status 和 /proc/meminfo */
+static long read_kb(const char *file, const char *key)
+{
+    char line[256];
+    long kb = -1;
+    size_t len = strlen(key);
+    FILE *fp = fopen(file, "r");
+
+    if (!fp)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (strncmp(line, key, len) == 0) {
+            kb = atol(line + len);
+            break;
+        }
+    }
+
+    fclose(fp);
+    return kb;
+}
+
+static long server_rss_kb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    return read_kb(path, "VmRSS:");
+}
+
+/* @brief 服务端RSS在 ms 毫秒内不再变化时返回, 用于等待服务端接收完所有连接 */
+static long settle_rss(pid_t pid, int ms)
+{
+    long last = server_rss_kb(pid), cur;
+
+    for (;;)
+    {
+        usleep(ms * 1000);
+        cur = server_rss_kb(pid);
+        if (cur == last)
+            return cur;
+        last = cur;
+    }
+}
+
+/* @brief 将进程的fd数量上限提高到硬限制 */
+static rlim_t raise_nofile(void)
+{
+    rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+        return 0;
+
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+}
+
+/* @brief 从源地址 src 阻塞地连接到 dst, 成功后设为非阻塞, 返回fd */
+static int dial(const sockaddr_in &src, const sockaddr_in &dst)
+{
+    int on = 1;
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+
+    if (fd == -1)
+        return -1;
+
+    /* 源端口在 connect 时按四元组分配, 不同源地址可以复用同一端口 */
+    ::setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    if (::bind(fd, (const sockaddr *)&src, sizeof(src)) == -1 ||
+        ::connect(fd, (const sockaddr *)&dst, sizeof(dst)) == -1) {
+        ::close(fd);
+        return -1;
+    }
+
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+naku::netio_task client(naku::tcp::conn c, size_t msgsize, conn_stat *st)
+{
+    ssize_t n;
+    auto wbuf = std::make_unique<char[]>(msgsize);
+    auto rbuf = std::make_unique<char[]>(msgsize);
+
+    ::memset(wbuf.get(), 'n', msgsize);
+
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        uint64_t start = now_ns();
+
+        for (size_t off = 0; off < msgsize; off += n)
+        {
+            n = co_await c.co_write(wbuf.get() + off, msgsize - off);
+            if (n <= 0)
+                goto failed;
+        }
+
+        for (size_t off = 0; off < msgsize; off += n)
+        {
+            n = co_await c.co_read(rbuf.get() + off, msgsize - off);
+            if (n <= 0)
+                goto failed;
+        }
+
+        st->lat.push_back(std::min<uint64_t>(now_ns() - start, UINT32_MAX));
+    }
+
+    running--;
+    co_return 0;
+
+failed:
+    st->errors++;
+    running--;
+    co_return -1;
+}
+
+static double percentile(const std::vector<uint32_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+
+    size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+    return v[i] / 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    std::string ip = "127.0.0.1";
+    uint16_t port = 8888;
+    long nconns = 10000;
+    double frac = 0.01;
+    int idle_sec = 5;
+    int seconds = 10;
+    size_t msgsize = 64;
+    int nsrc = 0;
+    pid_t server = 0;
+    const char *output = "connbench.jsonl";
+    const char *name = "conns";
+
+    while ((opt = getopt(argc, argv, "a:p:c:f:i:d:s:r:S:o:n:")) != -1)
+    {
+        switch (opt) {
+        case 'a': ip       = optarg; break;
+        case 'p': port     = atoi(optarg); break;
+        case 'c': nconns   = atol(optarg); break;
+        case 'f': frac     = atof(optarg); break;
+        case 'i': idle_sec = atoi(optarg); break;
+        case 'd': seconds  = atoi(optarg); break;
+        case 's': msgsize  = atoi(optarg); break;
+        case 'r': nsrc     = atoi(optarg); break;
+        case 'S': server   = atoi(optarg); break;
+        case 'o': output   = optarg; break;
+        case 'n': name     = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s -S server_pid [-a ip] [-p port] [-c conns] [-f active_fraction] [-i idle_sec]"
+                            " [-d sec] [-s size] [-r src_addrs] [-o file] [-n name]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (server == 0 || server_rss_kb(server) < 0) {
+        fprintf(stderr, "-S server_pid is required to measure the server\n");
+        return -1;
+    }
+
+    rlim_t nofile = raise_nofile();
+    if ((rlim_t)nconns + 64 > nofile) {
+        fprintf(stderr, "RLIMIT_NOFILE %lu is too small for %ld connections\n", (unsigned long)nofile, nconns);
+        return -1;
+    }
+
+    if (nsrc <= 0)
+        nsrc = nconns / 20000 + 1;
+
+    sockaddr_in dst, src;
+    ::memset(&dst, 0, sizeof(dst));
+    dst.sin_family = AF_INET;
+    dst.sin_port   = htons(port);
+    if (::inet_pton(AF_INET, ip.c_str(), &dst.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", ip.c_str());
+        return -1;
+    }
+    ::memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+
+    /* 0. 建立连接前的基线 */
+    long rss0  = settle_rss(server, 200);
+    long slab0 = read_kb("/proc/meminfo", "Slab:");
+    double cpu0;
+
+    /* 1. 建立所有连接, 源地址轮流使用 127.0.0.1 ~ 127.0.0.nsrc */
+    std::vector<int> fds;
+    fds.reserve(nconns);
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < nconns; i++)
+    {
+        src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + (i % nsrc));
+
+        int fd = dial(src, dst);
+        if (fd == -1) {
+            fprintf(stderr, "connection %ld: %s\n", i, strerror(errno));
+            return -1;
+        }
+        fds.push_back(fd);
+
+        if ((i + 1) % 100000 == 0)
+            fprintf(stderr, "%ld connections\n", i + 1);
+    }
+    double connect_sec = (now_ns() - t0) / 1e9;
+
+    /* 2. 等待服务端接收完所有连接, 测量每个连接的内存 */
+    long rss1  = settle_rss(server, 500);
+    long slab1 = read_kb("/proc/meminfo", "Slab:");
+
+    /* 3. 所有连接空闲时服务端的CPU占用 */
+    cpu0 = cpu_us(server);
+    sleep(idle_sec);
+    double idle_cpu = (cpu_us(server) - cpu0) / (idle_sec * 1e6) * 100;
+
+    /* 4. 均匀选取一部分连接做 ping-pong, 其余保持空闲 */
+    long nactive = std::max(1L, (long)(nconns * frac));
+    long step = nconns / nactive;
+    std::vector<conn_stat> stats(nactive);
+
+    naku::copool_init();
+
+    cpu0 = cpu_us(server);
+    uint64_t start = now_ns();
+    running = nactive;
+    for (long i = 0; i < nactive; i++)
+        naku::co_run(client, naku::tcp::conn(fds[i * step]), msgsize, &stats[i]);
+
+    sleep(seconds);
+    stop = true;
+
+    for (int i = 0; i < 5000 && running > 0; i++)
+        usleep(1000);
+
+    double elapsed = (now_ns() - start) / 1e9;
+    double active_cpu = cpu_us(server) - cpu0;
+
+    std::vector<uint32_t> lat;
+    uint64_t errors = 0;
+    for (auto &st : stats)
+    {
+        lat.insert(lat.end(), st.lat.begin(), st.lat.end());
+        errors += st.errors;
+    }
+    std::sort(lat.begin(), lat.end());
+    uint64_t reqs = lat.size();
+
+    char line[1024];
+    snprintf(line, sizeof(line),
+        "{\"name\":\"%s\",\"time\":%ld,\"conns\":%ld,\"active\":%ld,\"msgsize\":%zu,\"connect_sec\":%.3f,"
+        "\"server_rss_kb\":%ld,\"rss_bytes_per_conn\":%.0f,\"slab_bytes_per_conn\":%.0f,"
+        "\"idle_cpu_pct\":%.3f,\"seconds\":%.3f,\"requests\":%lu,\"errors\":%lu,\"rps\":%.0f,"
+        "\"lat_p50_us\":%.2f,\"lat_p99_us\":%.2f,\"lat_p999_us\":%.2f,\"lat_max_us\":%.2f,"
+        "\"server_cpu_us_per_req\":%.3f}",
+        name, (long)::time(NULL), nconns, nactive, msgsize, connect_sec,
+        rss1, (rss1 - rss0) * 1024.0 / nconns, (slab1 - slab0) * 1024.0 / nconns,
+        idle_cpu, elapsed, reqs, errors, reqs / elapsed,
+        percentile(lat, 0.50), percentile(lat, 0.99), percentile(lat, 0.999),
+        reqs ? lat.back() / 1e3 : 0.0, reqs ? active_cpu / reqs : -1.0);
+
+    printf("%s\n", line);
+
+    FILE *fp = fopen(output, "a");
+    if (fp) {
+        fprintf(fp, "%s\n", line);
+        fclose(fp);
+    } else {
+        perror(output);
+    }
+
+    fflush(stdout);
+    _exit(0);
+}
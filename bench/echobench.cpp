@@ -0,0 +1,216 @@
+/*
+ * echo 压测程序: 使用 naku 的 dialer 建立多个连接, 每个连接一个协程循环发送请求并等待回显
+ * 统计吞吐量, 延迟分位数(p50/p99/p999), 以及每个请求消耗的CPU时间
+ * 结果以一行JSON追加到 -o 指定的文件中, 便于比较多次运行的结果
+ *
+ * 用法: 先运行 examples/echoserver -q, 再运行
+ *       echobench [-a ip] [-p port] [-c 连接数] [-d 秒数] [-s 消息大小] [-S 服务端pid] [-o 结果文件] [-n 名称]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <naku/naku.h>
+
+/* @brief 每个连接的统计, 只由该连接的协程写入 */
+struct conn_stat
+{
+    std::vector<uint32_t> lat;  /* 每个请求的延迟(ns) */
+    uint64_t errors = 0;
+};
+
+static std::atomic<bool> stop(false);
+static std::atomic<int>  running(0);
+
+static inline uint64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* @brief 进程消耗的CPU时间(us), pid为0时为本进程 */
+static double cpu_us(pid_t pid)
+{
+    if (pid == 0) {
+        rusage ru;
+        ::getrusage(RUSAGE_SELF, &ru);
+        return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+    }
+
+    /* /proc/pid/stat 第14, 15个字段为 utime, stime, 单位为时钟滴答 */
+    char path[64];
+    unsigned long utime = 0, stime = 0;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    if (fscanf(fp, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return (utime + stime) * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+naku::netio_task client(naku::tcp::conn c, size_t msgsize, conn_stat *st)
+{
+    ssize_t n;
+    auto wbuf = std::make_unique<char[]>(msgsize);
+    auto rbuf = std::make_unique<char[]>(msgsize);
+
+    ::memset(wbuf.get(), 'n', msgsize);
+
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        uint64_t start = now_ns();
+
+        for (size_t off = 0; off < msgsize; off += n)
+        {
+            n = co_await c.co_write(wbuf.get() + off, msgsize - off);
+            if (n <= 0)
+                goto failed;
+        }
+
+        for (size_t off = 0; off < msgsize; off += n)
+        {
+            n = co_await c.co_read(rbuf.get() + off, msgsize - off);
+            if (n <= 0)
+                goto failed;
+        }
+
+        st->lat.push_back(std::min<uint64_t>(now_ns() - start, UINT32_MAX));
+    }
+
+    c.shutdown();
+    running--;
+    co_return 0;
+
+failed:
+    st->errors++;
+    c.shutdown();
+    running--;
+    co_return -1;
+}
+
+static double percentile(const std::vector<uint32_t> &v, double p)
+{
+    if (v.empty())
+        return 0;
+
+    size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+    return v[i] / 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    std::string ip = "127.0.0.1";
+    uint16_t port = 8888;
+    int nconns = 64;
+    int seconds = 10;
+    size_t msgsize = 64;
+    pid_t server = 0;
+    const char *output = "echobench.jsonl";
+    const char *name = "echo";
+
+    while ((opt = getopt(argc, argv, "a:p:c:d:s:S:o:n:")) != -1)
+    {
+        switch (opt) {
+        case 'a': ip      = optarg; break;
+        case 'p': port    = atoi(optarg); break;
+        case 'c': nconns  = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 's': msgsize = atoi(optarg); break;
+        case 'S': server  = atoi(optarg); break;
+        case 'o': output  = optarg; break;
+        case 'n': name    = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-a ip] [-p port] [-c conns] [-d sec] [-s size] [-S server_pid] [-o file] [-n name]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    naku::copool_init();
+
+    std::vector<naku::tcp::conn> conns(nconns);
+    for (int i = 0; i < nconns; i++)
+    {
+        if (naku::tcp::dialer::dialto(ip, port, conns[i]) == -1) {
+            perror("dial");
+            return -1;
+        }
+    }
+
+    std::vector<conn_stat> stats(nconns);
+    double ccpu = cpu_us(0);
+    double scpu = server ? cpu_us(server) : -1;
+    uint64_t start = now_ns();
+
+    running = nconns;
+    for (int i = 0; i < nconns; i++)
+        naku::co_run(client, conns[i], msgsize, &stats[i]);
+
+    sleep(seconds);
+    stop = true;
+
+    /* 等待所有协程结束, 对端异常时最多等待5秒 */
+    for (int i = 0; i < 5000 && running > 0; i++)
+        usleep(1000);
+
+    double elapsed = (now_ns() - start) / 1e9;
+    ccpu = cpu_us(0) - ccpu;
+    if (server)
+        scpu = cpu_us(server) - scpu;
+
+    std::vector<uint32_t> lat;
+    uint64_t errors = 0;
+    for (auto &st : stats)
+    {
+        lat.insert(lat.end(), st.lat.begin(), st.lat.end());
+        errors += st.errors;
+    }
+    std::sort(lat.begin(), lat.end());
+
+    uint64_t reqs = lat.size();
+    double mean = 0;
+    for (auto l : lat)
+        mean += l;
+    mean = reqs ? mean / reqs / 1e3 : 0;
+
+    char line[1024];
+    snprintf(line, sizeof(line),
+        "{\"name\":\"%s\",\"time\":%ld,\"conns\":%d,\"msgsize\":%zu,\"seconds\":%.3f,"
+        "\"requests\":%lu,\"errors\":%lu,\"rps\":%.0f,\"mbps\":%.2f,"
+        "\"lat_mean_us\":%.2f,\"lat_p50_us\":%.2f,\"lat_p99_us\":%.2f,\"lat_p999_us\":%.2f,\"lat_max_us\":%.2f,"
+        "\"client_cpu_us_per_req\":%.3f,\"server_cpu_us_per_req\":%.3f}",
+        name, (long)::time(NULL), nconns, msgsize, elapsed,
+        reqs, errors, reqs / elapsed, reqs * msgsize * 2 * 8 / elapsed / 1e6,
+        mean, percentile(lat, 0.50), percentile(lat, 0.99), percentile(lat, 0.999),
+        reqs ? lat.back() / 1e3 : 0.0,
+        reqs ? ccpu / reqs : 0.0, (server && reqs) ? scpu / reqs : -1.0);
+
+    printf("%s\n", line);
+
+    FILE *fp = fopen(output, "a");
+    if (fp) {
+        fprintf(fp, "%s\n", line);
+        fclose(fp);
+    } else {
+        perror(output);
+    }
+
+    fflush(stdout);
+    _exit(0);
+}
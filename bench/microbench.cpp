@@ -0,0 +1,231 @@
+/*
+ * 调度器和协程基本操作的微基准测试, 不依赖第三方库
+ * 每个用例在不同线程数下运行, 输出每个操作的耗时(ns/op)和内存分配次数(allocs/op)
+ * 结果以JSON行追加到 -o 指定的文件中, 与 echobench 相同, 便于比较修改调度器前后的结果
+ *
+ * 用法: microbench [-t 线程数列表, 如1,2,4] [-n 每线程操作次数] [-f 用例名过滤] [-o 结果文件]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <naku/naku.h>
+
+/* @brief 替换全局 operator new, 统计所有线程(包括调度线程)的内存分配次数 */
+static std::atomic<uint64_t> nallocs(0);
+
+void *operator new(std::size_t size)
+{
+    nallocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+using naku::netio_task;
+using naku::base::netco_pool;
+using naku::base::task_list;
+using naku::base::task_inbox;
+
+static netio_task noop(void)
+{
+    co_return 0;
+}
+
+/* @brief 每次被恢复后立即挂起 */
+static netio_task spin(void)
+{
+    for (;;)
+        co_await std::suspend_always{};
+    co_return 0;
+}
+
+struct result
+{
+    std::string name;
+    int threads;
+    uint64_t ops;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+static std::vector<result> results;
+
+/*
+ * @brief 启动 nthreads 个线程同时执行 f(ops), 统计总耗时和分配次数
+ *        ns/op 为单个线程执行一个操作的平均耗时: 总耗时 * 线程数 / 总操作数
+ */
+template <typename F>
+static void run(const char *name, int nthreads, uint64_t ops, F &&f)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> ths;
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        ths.emplace_back([&] {
+            ready++;
+            while (!go.load(std::memory_order_acquire))
+                ;
+            f(ops);
+        });
+    }
+
+    while (ready.load() != nthreads)
+        ;
+
+    uint64_t allocs = nallocs.load();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+
+    for (auto &t : ths)
+        t.join();
+
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t total = ops * nthreads;
+
+    result r{name, nthreads, total, ns * nthreads / total, double(nallocs.load() - allocs) / total};
+    printf("%-24s threads=%-3d ops=%-10lu %10.1f ns/op %8.2f allocs/op\n",
+           r.name.c_str(), r.threads, r.ops, r.ns_per_op, r.allocs_per_op);
+    fflush(stdout);
+    results.push_back(r);
+}
+
+/* @brief 等待提交的协程全部运行结束 */
+static void drain(void)
+{
+    while (netco_pool::get_instance().taskcount() > 0)
+        usleep(100);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    uint64_t nops = 200000;
+    std::vector<int> threads = {1, 2, 4};
+    const char *filter = "";
+    const char *output = "microbench.jsonl";
+
+    while ((opt = getopt(argc, argv, "t:n:f:o:")) != -1)
+    {
+        switch (opt) {
+        case 't':
+            threads.clear();
+            for (char *s = strtok(optarg, ","); s; s = strtok(NULL, ","))
+                threads.push_back(atoi(s));
+            break;
+        case 'n': nops   = strtoull(optarg, NULL, 10); break;
+        case 'f': filter = optarg; break;
+        case 'o': output = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t 1,2,4] [-n ops] [-f filter] [-o file]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    naku::copool_init();
+
+    auto enabled = [filter](const char *name) { return strstr(name, filter) != NULL; };
+
+    for (int nth : threads)
+    {
+        /* 1. 协程帧的创建和销毁 */
+        if (enabled("frame_create_destroy"))
+            run("frame_create_destroy", nth, nops, [](uint64_t n) {
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    netio_task t = noop();
+                    t.handle_.destroy();
+                }
+            });
+
+        /* 2. 直接 resume 一个挂起的协程 */
+        if (enabled("handle_resume"))
+            run("handle_resume", nth, nops, [](uint64_t n) {
+                netio_task t = spin();
+                for (uint64_t i = 0; i < n; i++)
+                    t.handle_.resume();
+                t.handle_.destroy();
+            });
+
+        /*
+         * 3. rr_sched 调度64个新建的协程直到结束, 每个操作为一次协程帧创建, 提交, resume 和销毁
+         *    rr_sched 要求协程恢复后要么等待IO要么结束, 减去 frame_create_destroy 即为调度开销
+         */
+        if (enabled("rr_sched_run_done"))
+            run("rr_sched_run_done", nth, nops, [](uint64_t n) {
+                const int ntasks = 64;
+                netco_pool::sched_worker w(&netco_pool::get_instance());
+
+                for (uint64_t i = 0; i < n / ntasks; i++)
+                {
+                    for (int j = 0; j < ntasks; j++)
+                        w.submit(noop());
+                    while (w.drain())
+                        w.rr_sched();
+                }
+            });
+
+        /*
+         * 4. 提交队列入队出队, 每个操作为一次入队加一次批量取出
+         *    侵入式队列的元素同一时刻只能在一个队列中, 每个线程使用自己的队列, 不测量锁竞争
+         */
+        if (enabled("task_inbox_enq_deq"))
+        {
+            run("task_inbox_enq_deq", nth, nops, [](uint64_t n) {
+                task_inbox que;
+                netio_task::promise_type p;
+                task_list out;
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    que.enqueue(&p);
+                    que.take(out);
+                    out.pop_front();
+                }
+            });
+        }
+
+        /* 5. 向协程池提交协程(不等待结束), 包括协程帧创建 */
+        if (enabled("pool_submit"))
+        {
+            run("pool_submit", nth, nops, [](uint64_t n) {
+                for (uint64_t i = 0; i < n; i++)
+                    naku::co_run(noop);
+            });
+            drain();
+        }
+
+        /* 6. 提交协程并通过信号量等待其结束: 提交, 唤醒调度线程, 运行, 唤醒等待者的往返 */
+        if (enabled("co_wait_handoff"))
+            run("co_wait_handoff", nth, nops / 10, [](uint64_t n) {
+                for (uint64_t i = 0; i < n; i++)
+                    naku::co_call(noop);
+            });
+    }
+
+    FILE *fp = fopen(output, "a");
+    if (!fp) {
+        perror(output);
+    } else {
+        for (auto &r : results)
+            fprintf(fp, "{\"name\":\"%s\",\"time\":%ld,\"threads\":%d,\"ops\":%lu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f}\n",
+                    r.name.c_str(), (long)::time(NULL), r.threads, r.ops, r.ns_per_op, r.allocs_per_op);
+        fclose(fp);
+    }
+
+    _exit(0);
+}
@@ -0,0 +1,118 @@
+/*
+ * 本机回环 UDP 收发包速率测试
+ * 发送线程使用 sendmmsg 批量发送, 接收线程使用 recvmmsg 批量接收, 统计每秒收发的数据报数量
+ *
+ * 用法: udp_pps [-t 秒数] [-b 每批消息数] [-s 数据报大小] [-g GSO每消息分段数] [-r 开启GRO] [-p 端口]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <unistd.h>
+
+#include <naku/naku.h>
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int seconds  = 5;
+    unsigned int nbatch = 64;
+    size_t   size  = 64;
+    unsigned int gsosegs = 0;
+    bool     gro   = false;
+    uint16_t port  = 9999;
+
+    while ((opt = getopt(argc, argv, "t:b:s:g:rp:")) != -1)
+    {
+        switch (opt) {
+        case 't': seconds = atoi(optarg); break;
+        case 'b': nbatch  = atoi(optarg); break;
+        case 's': size    = atoi(optarg); break;
+        case 'g': gsosegs = atoi(optarg); break;
+        case 'r': gro     = true; break;
+        case 'p': port    = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t sec] [-b batch] [-s size] [-g gsosegs] [-r] [-p port]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    naku::copool_init();
+
+    naku::udp::conn rx, tx;
+    if (rx.bind("127.0.0.1", port) == -1 || tx.connect("127.0.0.1", port) == -1) {
+        perror("udp socket");
+        return -1;
+    }
+
+    if (gro && rx.set_gro(true) == -1) {
+        perror("UDP_GRO");
+        return -1;
+    }
+
+    /* 开启GSO后每个消息包含 gsosegs 个数据报, 由内核切分 */
+    size_t msglen = gsosegs ? size * gsosegs : size;
+    if (gsosegs && tx.set_gso(size) == -1) {
+        perror("UDP_SEGMENT");
+        return -1;
+    }
+
+    std::atomic<bool> stop(false);
+    uint64_t sent = 0, received = 0;
+
+    std::thread receiver([&] {
+        naku::udp::batch b(nbatch, gro ? 65536 : size);
+
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            ssize_t n = rx.recvmmsg(b);
+            if (n <= 0)
+                continue;
+
+            for (ssize_t i = 0; i < n; i++)
+            {
+                uint16_t seg = b.segsize(i);
+                received += seg ? (b.len(i) + seg - 1) / seg : 1;
+            }
+        }
+    });
+
+    std::thread sender([&] {
+        naku::udp::batch b(nbatch, msglen);
+
+        for (unsigned int i = 0; i < nbatch; i++)
+            b.set(i, msglen);
+
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            ssize_t n = tx.sendmmsg(b, nbatch);
+            if (n > 0)
+                sent += n * (gsosegs ? gsosegs : 1);
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    sleep(seconds);
+    stop = true;
+
+    /* 发送一个数据报唤醒可能阻塞在 recvmmsg 的接收线程 */
+    sender.join();
+    naku::udp::batch wake(1, 1);
+    wake.set(0, 1);
+    tx.set_gso(0);
+    tx.sendmmsg(wake, 1);
+    receiver.join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("size=%zu batch=%u gso=%u gro=%d seconds=%.2f\n", size, nbatch, gsosegs, gro, elapsed);
+    printf("sent_pps=%.0f recv_pps=%.0f recv_mbps=%.1f loss=%.2f%%\n",
+           sent / elapsed, received / elapsed, received * size * 8 / elapsed / 1e6,
+           sent ? 100.0 * (sent - std::min(sent, received)) / sent : 0.0);
+
+    fflush(stdout);
+    _exit(0);
+}
@@ -8,35 +8,114 @@ naku::netio_task echo(naku::tcp::conn c)
 
     for (;;)
     {
-        ::memset(buf, 0, sizeof(buf));
-        std::cout << "wait read" << std::endl;
-        n = c.read(buf, sizeof(buf)-1);
-        std::cout << "read end" << std::endl;
-        if (n == -1) {
+        /* 在协程中必须使用 co_read/co_write, 阻塞的 read/write 会卡住调度线程 */
+        n = co_await c.co_read(buf, sizeof(buf));
+        if (n <= 0) {
             c.shutdown();
-            co_return -1;
+            co_return n;
         }
 
-        c.write(buf, n);
+        for (ssize_t off = 0; off < n; )
+        {
+            ssize_t m = co_await c.co_write(buf + off, n - off);
+            if (m == -1) {
+                c.shutdown();
+                co_return -1;
+            }
+            off += m;
+        }
     }
 
     co_return 0;
 }
 
-#include <unistd.h>
-
-int main(void)
+/*
+ * @brief 与 echo 相同, 但不持有自己的缓冲区
+ *        只在有数据可读时借用调度线程共享的缓冲区, 写完即归还, 等待数据时连接不占用缓冲区
+ */
+naku::netio_task echo_pooled(naku::tcp::conn c)
 {
-    naku::copool_init();
+    ssize_t n;
+    naku::base::pooled_buf buf;
+
+    for (;;)
+    {
+        n = co_await c.co_read(buf);
+        if (n <= 0) {
+            c.shutdown();
+            co_return n;
+        }
+
+        for (ssize_t off = 0; off < n; )
+        {
+            ssize_t m = co_await c.co_write(buf.data() + off, n - off);
+            if (m == -1) {
+                c.shutdown();
+                co_return -1;
+            }
+            off += m;
+        }
+
+        buf.release();
+    }
 
-    //sleep(10); // 测试等待一会再提交任务是否正常
+    co_return 0;
+}
 
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
     int ret;
     uint16_t clientport;
     std::string clientip;
     naku::tcp::conn c;
     naku::tcp::listener l;
-    l.listen("0.0.0.0", 8888);
+    int opt;
+    bool quiet = false;
+    bool pooled = false;
+    int metrics_port = 0;
+    naku::pool_options opts;
+
+    /*
+     * -q: 压测时不打印每个连接, -m port: 在该端口提供 Prometheus 格式的统计计数
+     * -p: 每个调度线程绑定一个CPU, -n node: 调度线程放在该NUMA节点上(可多次指定)
+     * -i park|spin|busy: 空闲策略
+     * -c max: 协程数量上限, -d us: CoDel 调度延迟目标值
+     * -b: 使用共享接收缓冲区(echo_pooled)
+     */
+    while ((opt = getopt(argc, argv, "qm:pn:i:c:d:b")) != -1)
+    {
+        switch (opt) {
+        case 'q': quiet = true; break;
+        case 'm': metrics_port = atoi(optarg); break;
+        case 'p': opts.pin = true; break;
+        case 'n': opts.nodes.push_back(atoi(optarg)); break;
+        case 'i':
+            opts.idle = !strcmp(optarg, "busy") ? naku::base::IDLE_BUSY :
+                        !strcmp(optarg, "spin") ? naku::base::IDLE_SPIN : naku::base::IDLE_PARK;
+            break;
+        case 'c': opts.max_coroutines = atoi(optarg); break;
+        case 'd': opts.codel_target_us = atoi(optarg); break;
+        case 'b': pooled = true; break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-q] [-m metrics_port] [-p] [-n numa_node] [-i park|spin|busy]"
+                      << " [-c max_coroutines] [-d codel_target_us] [-b]" << std::endl;
+            return -1;
+        }
+    }
+
+    naku::copool_init(opts);
+
+    if (metrics_port && naku::stats::serve("0.0.0.0", metrics_port) == -1) {
+        std::cout << "stats listen failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    if (l.listen("0.0.0.0", 8888) == -1) {
+        std::cout << "listen failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
 
     for (;;)
     {
@@ -46,17 +125,15 @@ int main(void)
             return -1;
         }
 
-        std::cout << "accept new connection from " << clientip << ":" << clientport << std::endl;
+        if (!quiet)
+            std::cout << "accept new connection from " << clientip << ":" << clientport << std::endl;
 
-
-        /* 方案存在问题:  
-         * 1. 我们要的是把echo函数也作为一个协程运行, 这样可以实现类似go语言的网络编程
-         * 2. 但是echo函数会卡住, 因此我们不能封装listener和conn, 但不封装很难用
-         *    而且是不支持嵌套协程, 虽然能创建, 但是一旦卡住就导致无法调度了
-         * 3. 在此案例中 echo 卡在了 读取数据这里, 而收数据的协程也不会被调度到了, 就卡死了
-         * 4. 通过优先队列获取任务最少的线程功能还未实现, 还需实现
-         * 5. 要考虑是否使用非对称协程了, c++的协程就是有这个问题
+        /*
+         * 1. 主线程通过阻塞的 accept 接收连接, 每个连接的 echo 函数作为一个协程运行, 类似go语言的网络编程
+         * 2. echo 中使用 co_read/co_write 挂起协程等待IO, 不会卡住调度线程
+         * 3. 协程交给任务最少的调度线程; 协程池已满时被拒绝, 关闭连接
          */
-        naku::co_run(echo, c);
+        if (!naku::co_run(pooled ? echo_pooled : echo, c).handle_)
+            c.shutdown();
     }
-}
\ No newline at end of file
+}
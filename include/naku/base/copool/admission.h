@@ -0,0 +1,28 @@
+#ifndef NAKU_ADMISSION_H
+#define NAKU_ADMISSION_H
+
+#include <atomic>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 准入控制的全局状态, 由协程池设置, async_accept 读取
+ *        单独放在这里是为了让 netio_wrap.h 不必依赖 copool.h
+ */
+class admission
+{
+public:
+	/*
+	 * @brief 协程池已满(达到协程数量上限, 或所有调度线程都在丢弃负载)时为true
+	 *        此时 async_accept 不再接收新连接, 连接留在内核的全连接队列中, 由内核对客户端产生背压
+	 */
+	static std::atomic<bool> &paused(void)
+	{
+		static std::atomic<bool> p{false};
+		return p;
+	}
+};
+
+} } // namespace
+
+#endif // NAKU_ADMISSION_H
@@ -3,8 +3,11 @@
 
 #include <cstdlib>
 #include <mutex>
-#include <list>
+#include <atomic>
+#include <array>
+#include <queue>
 #include <future>
+#include <condition_variable>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -17,17 +20,107 @@
 #include <unistd.h>
 #include <sys/epoll.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 
 #include <naku/base/poller/epoller.h>
 #include <naku/base/copool/netio_task.h>
-#include <naku/base/utils/task_queue.h>
+#include <naku/base/copool/stats.h>
+#include <naku/base/copool/registry.h>
+#include <naku/base/copool/admission.h>
+#include <naku/base/copool/run_budget.h>
 #include <naku/base/utils/utils.h>
+#include <naku/base/utils/affinity.h>
+#include <naku/base/utils/parker.h>
+#include <naku/base/utils/stackdump.h>
 
 namespace naku { namespace base {
 
+/*
+ * @brief 调度线程没有可运行协程时的行为
+ * IDLE_PARK: 阻塞在eventfd上, 不占用CPU, 唤醒延迟为一次系统调用加线程切换
+ * IDLE_SPIN: 先自旋等待一段时间再阻塞, 自旋时间根据最近自旋是否等到任务自适应调整
+ * IDLE_BUSY: 一直自旋不阻塞, IO线程也以0超时忙轮询epoll, 适合独占CPU的部署
+ */
+enum idle_policy { IDLE_PARK, IDLE_SPIN, IDLE_BUSY };
+
+/*
+ * @brief 协程池的线程数量和放置方式
+ * 1. cpus, nodes, pin 三选一, 按此优先级生效; 均未设置时不绑定CPU, 由内核调度
+ * 2. 绑定CPU后, 工作线程的数据结构在绑定后的线程上重新分配, 首次访问使内存落在该CPU所在的NUMA节点
+ */
+struct pool_options
+{
+	long nthreads = 0;          /* @brief 调度线程数量, 0: 绑定CPU时每个CPU一个, 否则为 utils::thread_num() */
+	std::vector<int> cpus;      /* @brief 调度线程依次绑定到这些CPU上, 每个线程一个CPU */
+	std::vector<int> nodes;     /* @brief 调度线程轮流分配到这些NUMA节点上, 每个线程可在所属节点的所有CPU上运行 */
+	bool pin = false;           /* @brief 每个调度线程绑定到一个进程允许使用的CPU上 */
+	int io_cpu = -1;            /* @brief IO多路复用线程绑定的CPU, -1 不绑定 */
+	bool skip_isolated = true;  /* @brief 不使用 /sys/devices/system/cpu/isolated 中被隔离的CPU */
+
+	idle_policy idle = IDLE_PARK;
+	unsigned int spin_us = 50;  /* @brief IDLE_SPIN 时最长的自旋时间(us) */
+	int busy_poll_us = 0;       /* @brief 大于0时对tcp/udp socket设置 SO_BUSY_POLL, 需要 CAP_NET_ADMIN 才能超过 sysctl net.core.busy_read */
+
+	/*
+	 * @brief 准入控制, 只限制 co_run 创建的协程, co_call 等阻塞调用由调用线程数量限制, 不受影响
+	 * 1. 超过上限时 co_run 拒绝创建协程(返回空的handle, errno 为 EAGAIN), async_accept 暂停接收新连接
+	 * 2. codel_target_us 大于0时启用CoDel: 调度线程的调度延迟持续 codel_interval_ms 都高于目标值时
+	 *    该线程进入丢弃状态不再接收新协程, 延迟回落到目标值以下或线程空闲时恢复
+	 */
+	std::size_t max_coroutines = 0;     /* @brief 协程总数上限, 0 不限制 */
+	std::size_t max_per_worker = 0;     /* @brief 每个调度线程的协程数量上限, 0 不限制 */
+	unsigned int codel_target_us = 0;
+	unsigned int codel_interval_ms = 100;
+
+	/*
+	 * @brief 优先级调度, 每个优先级一个就绪队列
+	 * 1. 每轮调度优先级 i 最多运行 prio_weights[i] 个协程
+	 *    每轮结束后重新取新就绪的协程, 新就绪的高优先级协程最多等待一轮, 不会排在所有低优先级协程后面
+	 * 2. 低优先级协程等待超过 starve_ms 时, 下一轮最先运行, 防止饿死
+	 */
+	unsigned int prio_weights[PRIO_NUM] = {16, 4, 1};
+	unsigned int starve_ms = 50;
+
+	/*
+	 * @brief 协作式调度的保护
+	 * 1. 协程每次被恢复后, 最多有 run_budget 次IO操作不挂起就完成, 之后的IO操作会让出调度线程(CO_YIELD), 0 不限制
+	 * 2. watchdog_ms 大于0时启动看门狗线程, 协程一次运行超过该时间未挂起时, 打印协程地址和调度线程的调用栈
+	 */
+	unsigned int run_budget = 128;
+	unsigned int watchdog_ms = 0;
+
+	/*
+	 * @brief 按实测的阻塞/CPU时间比例调整参与调度的线程数量, adapt_ms 大于0时启用, 每 adapt_ms 调整一次
+	 * 1. 启动时创建 max_threads 个调度线程, 新协程只分配给前面参与调度的线程; 其余线程运行完已有的协程后阻塞, 不占用CPU
+	 * 2. 目标数量 = utils::thread_num(阻塞时间/CPU时间), 限制在 [min_threads, max_threads]; 初始数量同未启用时
+	 * 3. 阻塞时间指协程中阻塞调用(文件IO, 阻塞的系统调用等)占用线程的时间, 等待IO事件的协程不占用线程, 不计入
+	 */
+	unsigned int adapt_ms = 0;
+	long min_threads = 1;
+	long max_threads = 0;       /* @brief 0 为CPU数的8倍, 不超过 utils::max_threads */
+
+	/*
+	 * @brief 分片模式, 每个调度线程拥有一个数据分片(worker_local), 分片内的数据只由该线程访问, 不需要加锁
+	 * 1. 调度线程中创建的协程(co_run, when_all 等)留在当前调度线程, 协程从不在调度线程之间迁移
+	 * 2. 访问其他分片时用 submit_to(id, f) 把协程交给该分片的调度线程运行, 并等待其结果
+	 * 3. 线程数量固定, 不使用 adapt_ms
+	 */
+	bool shard = false;
+
+	/*
+	 * @brief 收到该信号(如 SIGUSR2)时把所有存活协程的状态(见 netco_pool::dump)打印到标准输出, 0 不启用
+	 *        信号处理函数只写一个字节到管道, 由 naku-dump 线程生成输出
+	 */
+	int dump_signal = 0;
+};
+
 /* @brief 协程池类, 全局唯一实例, 单例模式 */
 class netco_pool
 {
+public:
+	class iomul_worker;
+	class sched_worker;
+
 private:
 	/* @brief 默认工作线程数量为2, 实际情况会多创建一个线程用于监控IO事件 */
 	netco_pool(unsigned int _nthreads = 2) : terminated(true), nthreads(_nthreads){}
@@ -49,24 +142,45 @@ public:
 
 public:
 	/* @brief 初始化协程池 */
-	void init(void)
+	void init(const pool_options &opts = pool_options())
 	{
 		long n;
+		std::vector<std::vector<int>> place;
 		
 		/* 0. 标记协程池运行状态 */
 		terminated = false;
+		options = opts;
+		if (options.shard && options.adapt_ms > 0) {
+			LOG_WARN << "adapt_ms is ignored in shard mode" << std::endl;
+			options.adapt_ms = 0;
+		}
 
 		/* 1. 启动IO监控线程 */
 		io_worker = std::make_unique<iomul_worker>(new epoller(), this);
-		io_worker->running();
-
-		/* 2. 启动调度线程 */
-		if ((n = utils::thread_num()) == -1) {
+		io_worker->running(opts.io_cpu >= 0 ? std::vector<int>{opts.io_cpu} : std::vector<int>());
+
+		/* 2. 启动调度线程, 绑定CPU时默认每个CPU一个线程 */
+		placement(opts, place);
+		if (opts.nthreads > 0) {
+			n = opts.nthreads;
+		} else if (!place.empty()) {
+			n = place.size();
+		} else if ((n = utils::thread_num()) == -1) {
 			// log("Get Core number failed, create n_threads thread")
 			n = nthreads;
 		}
 
-		for (long i = 0; i < n; i++)
+		/* 启用调整时按上限创建线程, 前 n 个参与调度 */
+		long total = n;
+		if (options.adapt_ms > 0)
+		{
+			total = opts.max_threads > 0 ? opts.max_threads : std::min(utils::max_threads, utils::cpu_num() * 8);
+			total = std::max(total, std::max(1L, opts.min_threads));
+			n = std::min(std::max(n, opts.min_threads), total);
+		}
+		active = n;
+
+		for (long i = 0; i < total; i++)
 		{
 			/* @brief 
 			 * 1. 由于sched_workers不支持拷贝, 因此不能接收emplace_back返回值, 也就不能在此处调用running()
@@ -76,28 +190,72 @@ public:
 			sched_workers.emplace_back(std::move(sched_worker(this)));
 		}
 
-		for (auto &w : sched_workers)
+		for (std::size_t i = 0; i < sched_workers.size(); i++)
 		{
-			w.running();
+			sched_workers[i].running(i, place.empty() ? std::vector<int>() : place[i % place.size()]);
 		}
+
+		/* 3. 启动看门狗线程和线程数量调整线程 */
+		if (opts.watchdog_ms > 0)
+			wd_thread = std::make_unique<std::thread>(&netco_pool::watchdog, this);
+		if (options.adapt_ms > 0)
+			adapt_thread = std::make_unique<std::thread>(&netco_pool::adapt, this);
+
+		/* 4. 启动收到 dump_signal 时打印协程状态的线程 */
+		if (opts.dump_signal > 0)
+			dump_install();
 	}
 
 	/* @brief 阻塞等待协程池结束 */
 	void evloop(void)
 	{
+		if (!io_worker)
+			return;
+
 		io_worker->stop();
 
 		for (auto &w : sched_workers)
 		{
 			w.stop();
 		}
+
+		if (wd_thread && wd_thread->joinable())
+			wd_thread->join();
+		if (adapt_thread && adapt_thread->joinable())
+			adapt_thread->join();
+		if (dump_thread && dump_thread->joinable())
+			dump_thread->join();
 	}
 
 	/* @brief 关闭协程池 */
 	void shutdown(void)
 	{
 		terminated = true;
+		if (io_worker)
+			io_worker->wakeup();
+		{
+			std::unique_lock<std::mutex> lock(wd_lock);
+			wd_cond.notify_all();
+		}
+		if (dump_pipe[1] != -1)
+			dump_wakeup();
 		evloop();
+		if (dump_pipe[0] != -1) {
+			::close(dump_pipe[0]);
+			::close(dump_pipe[1]);
+			dump_pipe[0] = dump_pipe[1] = -1;
+		}
+	}
+
+	/* @brief 按配置对socket设置 SO_BUSY_POLL, 未配置时不做任何事 */
+	int busy_poll(int fd)
+	{
+		int us = options.busy_poll_us;
+
+		if (us <= 0)
+			return 0;
+
+		return ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us));
 	}
 
 	/* 
@@ -108,47 +266,324 @@ public:
    	template <typename F, typename... Args>
 	netio_task submit(F &&f, Args &&...args)
 	{
-		static std::mutex submit_lock;
-
 		/* 
 		 1. submit 时, 直接运行协程, 由于协程设置启动时挂起
 		    即可在这里取到协程的handle
 		 2. 取到handle, 将返回的netio_task存储起来, 方便对协程进行控制(恢复)
-		 3. 使用优先队列(堆实现), 将任务放到任务量最少的线程上去
+		 3. 将任务放到任务量最少的线程上去
 		*/
-		netio_task task_handle = f(args...);
-		
+		return spawn(f(args...));
+	}
+
+	/*
+	 * @brief 按准入控制运行已创建的协程, 被拒绝时销毁协程
+	 * @param worker 运行协程的调度线程编号, -1 由协程池选择
+	 * @return 被拒绝时返回的 handle_ 为空, errno 为 EAGAIN
+	 */
+	netio_task spawn(netio_task task_handle, long worker = -1)
+	{
+		if (admit(task_handle, worker) == -1) {
+			task_handle.handle_.destroy();
+			task_handle.handle_ = nullptr;
+			errno = EAGAIN;
+		}
+
+		return task_handle;
+	}
+
+	/*
+	 * @brief 将已创建(启动时挂起)的协程交给调度线程运行, 不做准入控制
+	 * @param worker 运行协程的调度线程编号, -1 由协程池选择
+	 */
+	void schedule(netio_task task_handle, long worker = -1)
+	{
+		task_handle.handle_.promise().runnable_ts = utils::now_ns();
+
 		/* @brief lock 用于保护数据结构 sched_workers */
 		std::unique_lock<std::mutex> lock(submit_lock);
 
-		/* @brief 获取最小任务数量的worker */
-		std::cout << sched_workers[0].taskcount() << std::endl;
-		sched_workers[0].submit(task_handle);
+		place(false, worker)->submit(task_handle);
+	}
 
-		return task_handle;
+	/*
+	 * @brief 按准入控制将协程交给调度线程运行
+	 * @param worker 运行协程的调度线程编号, -1 由协程池选择
+	 * @return 成功返回0, 协程池已满(或指定的调度线程已满)返回-1, 此时协程未被调度, 由调用者销毁
+	 */
+	int admit(netio_task task_handle, long worker = -1)
+	{
+		sched_worker *w;
+
+		task_handle.handle_.promise().runnable_ts = utils::now_ns();
+
+		std::unique_lock<std::mutex> lock(submit_lock);
+
+		if (!has_capacity() || (w = place(true, worker)) == nullptr) {
+			rejected.fetch_add(1, std::memory_order_relaxed);
+			pause_accept();
+			return -1;
+		}
+
+		task_handle.handle_.promise().admitted = true;
+		w->submit(task_handle);
+
+		/* 刚好达到上限时提前暂停accept, 避免再接收一个注定被拒绝的连接 */
+		if (!has_capacity())
+			pause_accept();
+
+		return 0;
+	}
+
+	/* @brief 调度线程进入CoDel丢弃状态时调用, 所有线程都在丢弃时提前暂停accept */
+	void overloaded(void)
+	{
+		std::unique_lock<std::mutex> lock(submit_lock);
+
+		if (least_loaded(true) == nullptr)
+			pause_accept();
+	}
+
+	/* @brief 协程结束时由调度线程调用, 协程池从满变为有空余时恢复被暂停的accept */
+	void finished(void)
+	{
+		if (admission::paused().load(std::memory_order_relaxed))
+			resume_accept();
+	}
+
+	/* @brief 取消等待IO的协程, 由 cancel_source::request() 调用 */
+	void cancel_io(netio_task task) { io_worker->cancel(task); }
+
+	/* @brief 当前线程的调度线程编号, 不是调度线程时返回-1 */
+	static long worker_id(void) {return t_worker_id;}
+
+	/* @brief 调度线程数量, 编号为 [0, worker_count()) */
+	std::size_t worker_count(void) const {return sched_workers.size();}
+
+	/* @brief 调度线程是否参与分配新协程 */
+	bool is_active(const sched_worker *w) const
+	{
+		return (std::size_t)(w - sched_workers.data()) < active.load(std::memory_order_relaxed);
+	}
+
+	/* @brief 获取协程池中尚未结束的协程数量 */
+	std::size_t taskcount(void)
+	{
+		std::size_t n = 0;
+
+		for (auto &w : sched_workers)
+			n += w.taskcount();
+
+		return n;
+	}
+
+	/* @brief 汇总各线程的统计计数, 只读取计数器, 不影响调度线程 */
+	void snapshot(pool_snapshot &snap)
+	{
+		uint64_t dsum = 0, dmax = 0, wsum = 0, wmax = 0;
+		uint64_t psum[PRIO_NUM] = {0}, pmax[PRIO_NUM] = {0};
+		std::vector<uint64_t> delay, iowait, pdelay[PRIO_NUM];
+
+		snap.workers.clear();
+
+		for (std::size_t i = 0; i < sched_workers.size(); i++)
+		{
+			auto &w  = sched_workers[i];
+			auto &st = w.get_stats();
+
+			snap.workers.push_back({i, w.taskcount(), stat_get(st.ready), w.queuedepth(),
+				stat_get(st.resumes), stat_get(st.passes), stat_get(st.parks), stat_get(st.park_ns), stat_get(st.spins), w.is_shedding(), stat_get(st.starved),
+				stat_get(st.yields), stat_get(st.busy_ns), i < active.load(std::memory_order_relaxed),
+				st.sched_delay.summary(), st.io_wait.summary()});
+
+			st.sched_delay.load(delay, dsum, dmax);
+			st.io_wait.load(iowait, wsum, wmax);
+			for (int c = 0; c < PRIO_NUM; c++)
+				st.prio_delay[c].load(pdelay[c], psum[c], pmax[c]);
+		}
+
+		snap.sched_delay = histogram::summarize(delay, dsum, dmax);
+		snap.io_wait     = histogram::summarize(iowait, wsum, wmax);
+		for (int c = 0; c < PRIO_NUM; c++)
+			snap.prio_delay[c] = histogram::summarize(pdelay[c], psum[c], pmax[c]);
+
+		snap.rejected     = rejected.load(std::memory_order_relaxed);
+		snap.accept_pause = pauses.load(std::memory_order_relaxed);
+		snap.paused       = admission::paused().load(std::memory_order_relaxed);
+		snap.long_runs    = long_runs.load(std::memory_order_relaxed);
+		snap.io_cancels   = io_cancels.load(std::memory_order_relaxed);
+		snap.active       = active.load(std::memory_order_relaxed);
+		snap.io_ratio     = io_ratio.load(std::memory_order_relaxed);
+
+		auto &pst = io_worker->get_stats();
+		snap.wakeups  = stat_get(pst.wakeups);
+		snap.events   = stat_get(pst.events);
+		snap.timeouts = stat_get(pst.timeouts);
+	}
+
+	/*
+	 * @brief 打印所有存活协程的状态, 用于排查卡住的协程(如一直等待IO的连接), 可在任意线程调用
+	 * 1. 每个协程一行: 调度线程, 协程帧地址, 状态, 处于该状态的时间, 等待的fd和事件, 优先级, 创建协程的协程函数
+	 *    状态为 RUNNING(正在运行), READY(等待调度), IOWAIT(等待IO事件), THROTTLED(协程池已满暂停), JOIN(等待子协程)
+	 * 2. 按处于当前状态的时间从长到短排序, 只打印超过 min_age_ms 的协程; 最后一行为各状态的协程数量
+	 * 3. 只在协程被调度线程取走后才登记, 已提交尚未被取走的协程不在其中(见 naku_worker_submit_queue_depth)
+	 */
+	void dump(std::ostream &out, unsigned int min_age_ms = 0);
+
+private:
+	/*
+	 * @brief 选择运行新协程的调度线程, 需持有 submit_lock
+	 * 1. 指定了 worker 时只能是它, admit 为true且它已满时返回nullptr
+	 * 2. 分片模式下在调度线程中创建的协程留在当前调度线程
+	 * 3. 否则为 least_loaded(admit)
+	 */
+	sched_worker *place(bool admit, long worker)
+	{
+		if (worker < 0 && options.shard)
+			worker = t_worker_id;
+		if (worker < 0)
+			return least_loaded(admit);
+
+		sched_worker &w = sched_workers[worker];
+		return (!admit || w.accepting()) ? &w : nullptr;
+	}
+
+	/*
+	 * @brief 在参与调度的线程中获取任务数量最少的调度线程, 需持有 submit_lock
+	 * @param admit 为true时跳过已满或正在丢弃负载的线程, 都不可用时返回nullptr
+	 */
+	sched_worker *least_loaded(bool admit)
+	{
+		sched_worker *best = nullptr;
+		std::size_t n = active.load(std::memory_order_relaxed);
+
+		for (std::size_t i = 0; i < n; i++)
+		{
+			auto &w = sched_workers[i];
+
+			if (admit && !w.accepting())
+				continue;
+			if (best == nullptr || w.taskcount() < best->taskcount())
+				best = &w;
+		}
+
+		return best;
+	}
+
+	/*
+	 * @brief 是否未达到协程总数上限, 需持有 submit_lock
+	 *        只计算经过准入控制创建的协程, 否则被暂停的accept协程自身也占用名额, 永远无法恢复
+	 */
+	bool has_capacity(void)
+	{
+		std::size_t n = 0;
+
+		if (options.max_coroutines == 0)
+			return true;
+
+		for (auto &w : sched_workers)
+			n += w.admitcount();
+
+		return n < options.max_coroutines;
+	}
+
+	/* @brief 暂停accept, 需持有 submit_lock */
+	void pause_accept(void)
+	{
+		if (!admission::paused().exchange(true, std::memory_order_relaxed))
+			pauses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/* @brief 协程池有空余容量时恢复accept, 将被暂停的accept协程交给IO线程监控 */
+	void resume_accept(void)
+	{
+		task_list waiters;
+		netio_task::promise_type *p;
+
+		{
+			std::unique_lock<std::mutex> lock(submit_lock);
+
+			if (!has_capacity() || least_loaded(true) == nullptr)
+				return;
+
+			admission::paused().store(false, std::memory_order_relaxed);
+			waiters.splice(throttled);
+		}
+
+		while ((p = waiters.pop_front()) != nullptr)
+			io_worker->ioevent_add(netio_task::from_promise(*p), p->events);
 	}
 
+	/*
+	 * @brief 协程因协程池已满挂起(CO_THROTTLED), 由所属调度线程调用
+	 *        挂起前检查到已满, 到此时可能已有空余, 需在锁内重新检查, 否则可能永远不被唤醒
+	 */
+	void throttle(netio_task task)
+	{
+		{
+			std::unique_lock<std::mutex> lock(submit_lock);
+
+			if (admission::paused().load(std::memory_order_relaxed)) {
+				throttled.push_back(&task.handle_.promise());
+				return;
+			}
+		}
+
+		io_worker->ioevent_add(task, task.handle_.promise().events);
+	}
+
+	/*
+	 * @brief 根据配置计算调度线程的放置, place[i] 为第 i 个位置可使用的CPU, 线程依次轮流使用各位置
+	 *        不需要绑定, 或可用的CPU为空时 place 为空
+	 */
+	static void placement(const pool_options &opts, std::vector<std::vector<int>> &place);
+
+	/* @brief 看门狗线程, 定期检查各调度线程当前协程的运行时间 */
+	void watchdog(void);
+
+	/* @brief 线程数量调整线程, 定期根据阻塞/CPU时间比例调整参与调度的线程数量 */
+	void adapt(void);
+
+	/* @brief 安装 dump_signal 的信号处理函数, 启动 naku-dump 线程 */
+	void dump_install(void);
+
+	/* @brief 唤醒 naku-dump 线程, 关闭协程池时使其退出 */
+	void dump_wakeup(void);
+
 public:
 	/* @brief IO多路复用监控IO事件线程 */
 	class iomul_worker
 	{
 	public:
 		iomul_worker(poller *_poller, netco_pool *_pool) : 
-			poll(_poller), pool(_pool) {}
+			poll(_poller), pool(_pool), cancel_que(std::make_unique<task_inbox>()) {}
+
+		/* @brief 新增IO事件进行监控, 事件发生时通过协程句柄的地址找回协程 */
+		int ioevent_add(netio_task task, int events);
 
-		/* @brief 新增IO事件进行监控 */
-		int ioevent_add(netio_task *task, int events);
+		/* @brief 取消等待IO的协程, 可在任意线程调用, 由IO线程注销fd并唤醒协程 */
+		void cancel(netio_task task);
 
-		/* @brief 对协程IO事件进行监控, 发生IO事件时修改协程状态 */
-		void running(void);
+		/* @brief 对协程IO事件进行监控, 发生IO事件时修改协程状态, cpus 不为空时线程绑定到这些CPU */
+		void running(const std::vector<int> &cpus = std::vector<int>());
 
 		/* @brief 等待线程结束 */
 		void stop(void);
 
+		/* @brief 获取IO事件监控的统计计数 */
+		const poll_stats &get_stats(void) const {return poll->get_stats();}
+
+		/* @brief 唤醒阻塞在epoll_wait中的IO线程 */
+		void wakeup(void) {poll->wakeup();}
+
+	private:
+		/* @brief 处理被取消的协程, 每次 epoll_wait 返回后调用 */
+		void reap(void);
+
 	private:
 		std::unique_ptr<std::thread> th;
 		std::unique_ptr<poller> poll;
 		netco_pool *pool;
+		std::unique_ptr<task_inbox> cancel_que;  /* @brief 已从取消来源的等待列表中取走, 等待IO线程注销fd的协程 */
 	};
 
 	/* @brief 调度执行协程的线程 */
@@ -159,8 +594,9 @@ public:
 
 	public:
 		sched_worker(netco_pool *_pool) : 
-			tasknum(0), pool(_pool), task_que(std::make_unique<task_queue<netio_task>>()),
-			m_cond_lock(std::make_unique<std::mutex>()), m_cond(std::make_unique<std::condition_variable>()) {}
+			tasknum(0), admitted(0), spin_ns(0), codel_first_above(0), shedding(false), pool(_pool), task_que(std::make_unique<task_inbox>()),
+			ready_que(std::make_unique<task_inbox>()), m_parker(std::make_unique<parker>()),
+			stats(std::make_unique<sched_stats>()), registry(std::make_unique<coroutine_registry>()) {}
 
 		/* @brief move construct. */
 		sched_worker(sched_worker&& w)
@@ -168,12 +604,19 @@ public:
 			if (this == &w)
 				return;
 
-			this->tasknum = w.tasknum;
+			this->tasknum = w.tasknum.load();
+			this->admitted = w.admitted.load();
+			this->spin_ns = w.spin_ns;
+			this->codel_first_above = w.codel_first_above;
+			this->shedding = w.shedding.load();
 			this->th = std::move(w.th);
 			this->pool = w.pool;
-			this->m_cond = std::move(w.m_cond);
-			this->m_cond_lock = std::move(w.m_cond_lock);
 			this->task_que = std::move(w.task_que);
+			this->ready_que = std::move(w.ready_que);
+			this->runq = std::move(w.runq);
+			this->m_parker = std::move(w.m_parker);
+			this->stats = std::move(w.stats);
+			this->registry = std::move(w.registry);
 		}
 
 		sched_worker& operator=(sched_worker&& w)
@@ -181,43 +624,113 @@ public:
 			if (this == &w)
 				return *this;
 
-			this->tasknum = w.tasknum;
+			this->tasknum = w.tasknum.load();
+			this->admitted = w.admitted.load();
+			this->spin_ns = w.spin_ns;
+			this->codel_first_above = w.codel_first_above;
+			this->shedding = w.shedding.load();
 			this->th = std::move(w.th);
 			this->pool = w.pool;
-			this->m_cond = std::move(w.m_cond);
-			this->m_cond_lock = std::move(w.m_cond_lock);
 			this->task_que = std::move(w.task_que);
+			this->ready_que = std::move(w.ready_que);
+			this->runq = std::move(w.runq);
+			this->m_parker = std::move(w.m_parker);
+			this->stats = std::move(w.stats);
+			this->registry = std::move(w.registry);
 			return *this;
 		}
 
 		/* 
 		* @brief 对协程进行调度, 销毁运行结束的协程, 处理协程IO事件
-		*        这里使用了一个与用户线程交互的任务队列和调度线程独有的任务列表
-		*        解决了用户线程提交任务和调度线程遍历任务调度的竞争问题
-		* @param task_que 保存用户submit的协程任务
-		* @param poll IO多路复用对象，用于监控IO事件
+		*        这里使用了与用户线程/IO线程交互的任务队列和调度线程独有的各优先级就绪队列
+		*        解决了用户线程提交任务和调度线程调度的竞争问题
+		* @param id   线程编号, 用于线程命名 naku-sched-<id>
+		* @param cpus 线程绑定的CPU, 为空时不绑定
 		*/
-		void running(void);
+		void running(std::size_t id = 0, const std::vector<int> &cpus = std::vector<int>());
+
+		/* @brief 从提交队列和IO就绪队列取出协程放入各优先级的就绪队列, 返回就绪协程总数 */
+		std::size_t drain(void);
 
-		/* @brief 轮循调度协程 */
-		void rr_sched(std::list<netio_task>& list);
+		/* @brief 按优先级加权轮循调度一轮 */
+		void rr_sched(void);
 
 		/* @brief 等待线程结束 */
 		void stop(void);
 
 		/* @brief 获取任务数量 */
-		std::size_t taskcount(void) {return *tasknum;}
+		std::size_t taskcount(void) {return tasknum.load(std::memory_order_relaxed);}
+
+		/* @brief 获取经过准入控制创建的任务数量 */
+		std::size_t admitcount(void) {return admitted.load(std::memory_order_relaxed);}
+
+		/* @brief 获取已提交但尚未被调度线程取走的任务数量 */
+		std::size_t queuedepth(void) {return task_que->size();}
+
+		/* @brief 获取调度统计计数 */
+		const sched_stats &get_stats(void) const {return *stats;}
+
+		/* @brief 获取存活协程登记表, 用于 dump */
+		coroutine_registry &get_registry(void) {return *registry;}
+
+		/* @brief 获取线程句柄, 用于看门狗打印调用栈 */
+		std::thread::native_handle_type native_handle(void) {return th->native_handle();}
 
 		/* @brief 提交任务 */
 		void submit(netio_task task)
 		{
+			NAKU_PROBE2(submit, task.handle_.address(), this - pool->sched_workers.data());
 			tasknum++;
-			task_que->enqueue(task);
-			m_cond->notify_one();
+			if (task.handle_.promise().admitted)
+				admitted++;
+			task_que->enqueue(&task.handle_.promise());
+			m_parker->unpark();
+		}
+
+		/* @brief 是否可以接收新协程: 未达到每线程上限, 且未处于CoDel丢弃状态 */
+		bool accepting(void)
+		{
+			std::size_t max = pool->options.max_per_worker;
+
+			if (max != 0 && admitted.load(std::memory_order_relaxed) >= max)
+				return false;
+
+			return !shedding.load(std::memory_order_relaxed);
 		}
 
+		/* @brief 是否处于CoDel丢弃状态 */
+		bool is_shedding(void) const {return shedding.load(std::memory_order_relaxed);}
+
+		/* @brief IO事件发生, 由IO线程将等待IO的协程交还给调度线程, 由调度线程修改其运行状态 */
+		void wakeup(netio_task task)
+		{
+			ready_que->enqueue(&task.handle_.promise());
+			m_parker->unpark();
+		}
+
+	private:
+		/* @brief 没有可运行的协程时, 按 idle_policy 等待新任务或IO事件 */
+		void idle(void);
+
+		/* @brief 恢复运行一个就绪协程, 并根据其挂起原因交给IO线程监控或销毁 */
+		void run(netio_task task);
+
+		/* @brief when_all/when_any 的子协程结束, 交给等待的 join_state */
+		void joined(netio_task task);
+
+		/* @brief 根据一次调度延迟更新CoDel状态 */
+		void codel(uint64_t delay, uint64_t now);
+
+		/* @brief 退出CoDel丢弃状态 */
+		void stop_shedding(void);
+
 	private:
-		posit_num tasknum;
+		/* @brief 提交线程增加, 调度线程减少, 需要原子操作 */
+		std::atomic<std::size_t> tasknum;
+		std::atomic<std::size_t> admitted;  /* @brief 经过准入控制创建的协程数量, 用于判断是否已满 */
+		uint64_t spin_ns;  /* @brief IDLE_SPIN 当前的自旋时间, 只由调度线程访问 */
+		uint64_t codel_first_above;  /* @brief 调度延迟开始持续高于目标值的时间加上间隔, 0表示未高于 */
+		std::atomic<bool> shedding;  /* @brief CoDel丢弃状态, 调度线程写入, 提交线程读取 */
 		netco_pool *pool;
 
 		/* 
@@ -225,14 +738,37 @@ public:
 		 * 使用vector需要实现拷贝或移动构造函数
 		 */
 		std::unique_ptr<std::thread> th;
-		std::unique_ptr<task_queue<netio_task>> task_que;
-		std::unique_ptr<std::mutex> m_cond_lock;
-		std::unique_ptr<std::condition_variable> m_cond;
+		std::unique_ptr<task_inbox> task_que;
+		std::unique_ptr<task_inbox> ready_que;   /* @brief IO事件已发生, 等待恢复运行的协程 */
+		std::array<task_list, PRIO_NUM> runq;    /* @brief 各优先级的就绪队列, 只由调度线程访问 */
+		std::unique_ptr<parker> m_parker;
+		std::unique_ptr<sched_stats> stats;
+		std::unique_ptr<coroutine_registry> registry;  /* @brief 本线程的存活协程 */
 	};
 
 private:
-	bool terminated;
+	std::atomic<bool> terminated;
 	unsigned int nthreads;
+	pool_options options;
+
+	std::mutex submit_lock;               /* @brief 保护 sched_workers 的选择和 throttled */
+	task_list throttled;                  /* @brief 因协程池已满而暂停的accept协程 */
+	std::atomic<uint64_t> rejected{0};    /* @brief 被拒绝创建的协程数量 */
+	std::atomic<uint64_t> pauses{0};      /* @brief accept被暂停的次数 */
+	std::atomic<uint64_t> long_runs{0};   /* @brief 看门狗发现的运行超时次数 */
+	std::atomic<uint64_t> io_cancels{0};  /* @brief 等待IO时被取消唤醒的协程数量 */
+
+	std::unique_ptr<std::thread> wd_thread;
+	std::unique_ptr<std::thread> adapt_thread;
+	std::mutex wd_lock;
+	std::condition_variable wd_cond;      /* @brief 关闭协程池时唤醒看门狗线程和调整线程 */
+
+	std::atomic<std::size_t> active{0};   /* @brief 参与分配新协程的调度线程数量, 为 sched_workers 的前 active 个 */
+	static thread_local long t_worker_id; /* @brief 调度线程中为其编号, 其他线程为-1 */
+	std::atomic<double> io_ratio{-1};     /* @brief 实测的阻塞/CPU时间比例 */
+
+	std::unique_ptr<std::thread> dump_thread;
+	int dump_pipe[2] = {-1, -1};          /* @brief 信号处理函数写入 dump_pipe[1], naku-dump 线程读取 dump_pipe[0] */
 
 	std::unique_ptr<iomul_worker> io_worker;
 	std::vector<sched_worker> sched_workers;
@@ -1,23 +1,57 @@
 #ifndef NAKU_NETIO_TASK_H
 #define NAKU_NETIO_TASK_H
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <mutex>
 #include <coroutine>
 #include <semaphore>
+#include <source_location>
 
 #include <sys/epoll.h>
 
+#include <naku/base/utils/intrusive_queue.h>
+#include <naku/base/utils/probe.h>
+
 namespace naku { namespace base {
 
-/* @brief 协程运行状态 */
-enum CO_STATE { CO_RUNNING, CO_IOWAIT};
+/*
+ * @brief 协程运行状态
+ * CO_THROTTLED: 协程池已满, 暂缓监控IO事件(目前只用于accept), 有空余容量时再交给IO线程监控
+ * CO_YIELD: 协程主动让出(yield)或用完了本次运行的预算, 放回就绪队列末尾
+ * CO_JOIN: 等待 when_all/when_any 的子协程结束, 由最后结束的子协程唤醒
+ */
+enum CO_STATE { CO_RUNNING, CO_IOWAIT, CO_THROTTLED, CO_YIELD, CO_JOIN};
+
+/*
+ * @brief 协程优先级, 数值越小优先级越高
+ * PRIO_HIGH: 延迟敏感的小请求, PRIO_NORMAL: 默认, PRIO_LOW: 大文件传输等批量任务
+ */
+enum CO_PRIO { PRIO_HIGH, PRIO_NORMAL, PRIO_LOW, PRIO_NUM };
+
+class cancel_source;
+class join_state;
 
 /* @brief 将一个协程封装为一个netio_task任务 */
 class netio_task {
 public:
     class promise_type {
     public:
-		promise_type() : fd(-1), run_state(CO_RUNNING), events(EPOLLIN), wait(false), sem(0) {}
+		/* @brief 默认参数在协程函数中求值, _site 即为协程函数的名字和位置 */
+		promise_type(std::source_location _site = std::source_location::current()) :
+			fd(-1), run_state(CO_RUNNING), prio(PRIO_NORMAL), events(EPOLLIN),
+			owner(nullptr), next(nullptr), cancel(nullptr), park_prev(nullptr), park_next(nullptr), parked(false),
+			wait_cancelled(nullptr), joiner(nullptr), join_index(0), waiting(nullptr),
+			site(_site), reg_prev(nullptr), reg_next(nullptr), state_ts(0),
+			runnable_ts(0), iowait_ts(0), admitted(false), wait(false), sem(0)
+		{
+			NAKU_PROBE4(co_create, std::coroutine_handle<promise_type>::from_promise(*this).address(),
+				_site.function_name(), _site.file_name(), _site.line());
+		}
+
+		/* @brief 释放持有的取消来源 */
+		~promise_type();
 
         /* @brief 设置协程启动时挂起 */
         std::suspend_always initial_suspend() { return {}; }
@@ -26,9 +60,11 @@ public:
         netio_task get_return_object()
         { return {netio_task(std::coroutine_handle<netio_task::promise_type>::from_promise(*this))}; }
         
-        /* @brief 设置协程结束(co_return)时挂起 */
-        std::suspend_always final_suspend() noexcept 
-        { sem.release(); return {}; }
+        /* @brief 设置协程结束(co_return)时挂起
+         * 不在此处唤醒等待者: 此时协程尚未完全挂起, 调度线程也还要访问协程帧
+         * 由调度线程在不再使用协程帧后调用 sem.release()
+         */
+        std::suspend_always final_suspend() noexcept { return {}; }
 
         /* @brief 设置协程结束时(co_return)返回值为ssize_t */
 		void return_value(ssize_t status) {ret_status = status;}
@@ -36,21 +72,238 @@ public:
         /* @brief 定义发生异常时的行为 */
         void unhandled_exception() { throw; }
 
+        /* @brief IO操作通过 root() 设置等待的fd和运行状态, netio_task 自身就是最外层协程 */
+        promise_type &root() { return *this; }
+
+        /* @brief 是否已被请求取消, IO操作在挂起前检查, 已取消时不再等待IO, 返回 -1 且 errno 为 ECANCELED */
+        bool cancelled(void) const;
+
     public:
 		int fd;              /* @brief 保存等待IO事件的fd */
 		ssize_t ret_status;  /* @brief 保存协程返回值 */
 		CO_STATE run_state;  /* @beief 保存协程的运行状态 */
+		CO_PRIO prio;        /* @brief 调度优先级 */
 		uint32_t events;     /* @brief 保存要监控的事件 */
+		void *owner;         /* @brief 所属的调度线程(sched_worker), IO事件发生时将协程交还给它 */
+		promise_type *next;  /* @brief 所在队列(task_list)中的下一个协程, 协程同一时刻只在一个队列中 */
+		std::coroutine_handle<> leaf; /* @brief 正在 co_await 的最内层 task, 调度线程恢复它; 为空时恢复本协程 */
+
+		cancel_source *cancel;   /* @brief 取消请求的来源, 持有它的一个引用; 为空表示不可取消 */
+		promise_type *park_prev; /* @brief 等待IO期间在 cancel 的等待列表中的前后协程, 由 cancel 的锁保护 */
+		promise_type *park_next;
+		bool parked;             /* @brief 是否在 cancel 的等待列表中, 由 cancel 的锁保护 */
+		bool *wait_cancelled;    /* @brief 正在等待的IO操作的取消标记, 等待期间被取消时置位, 该操作返回 ECANCELED */
+		join_state *joiner;      /* @brief 作为 when_all/when_any 的子协程时, 结束后将返回值交给它 */
+		std::size_t join_index;  /* @brief 在 when_all/when_any 中的序号 */
+		join_state *waiting;     /* @brief CO_JOIN 状态时正在等待的子协程集合 */
+
+		std::source_location site;  /* @brief 创建协程的协程函数, 用于 dump */
+		promise_type *reg_prev;     /* @brief 在所属调度线程存活协程登记表(coroutine_registry)中的前后协程 */
+		promise_type *reg_next;
+		uint64_t state_ts;          /* @brief 最近一次挂起的时间, 即进入 IOWAIT/THROTTLED/JOIN 状态的时间 */
+
+		uint64_t runnable_ts; /* @brief 变为可运行(提交或IO事件发生)的时间, 用于统计调度延迟 */
+		uint64_t iowait_ts;   /* @brief 开始等待IO的时间, 为0表示未等待IO */
+
+		bool admitted;        /* @brief 是否经过准入控制创建, 计入协程数量上限 */
 
         bool wait; /* @brief 标记是否有人在等待协程结束 */
         std::counting_semaphore<1> sem;  /* @brief 用于等待协程任务结束 */
     };
 
 public:
+    /* @brief 由promise找回协程 */
+    static netio_task from_promise(promise_type &p)
+    { return {std::coroutine_handle<netio_task::promise_type>::from_promise(p)}; }
+
     /* @brief 保存控制协程的句柄 */
     std::coroutine_handle<netio_task::promise_type> handle_;
 };
 
+/* @brief 以 promise 中的 next 串起的协程队列, 调度和IO唤醒时入队出队都不分配内存 */
+using task_list  = intrusive_queue<netio_task::promise_type, &netio_task::promise_type::next>;
+using task_inbox  = mpsc_queue<netio_task::promise_type, &netio_task::promise_type::next>;
+
+/*
+ * @brief 取消请求, 可取消的协程的 promise 持有它的一个引用, 引用计数为0时销毁
+ * 1. 以 parent 创建的取消来源持有 parent 的引用, parent 被取消时一起取消
+ *    when_all/when_any 的子协程以父协程的取消来源为 parent
+ * 2. 可取消的协程等待IO期间挂在等待列表中; request() 取走列表中的协程, 交给IO线程注销fd后以 ECANCELED 唤醒
+ *    IO事件与取消同时发生时, 以先在锁内把协程从列表中取走的一方为准, 另一方不再访问该协程
+ * 3. 只有等待IO的协程会被立即唤醒, 就绪或因协程池已满暂停的协程在下一次等待IO时返回 ECANCELED
+ */
+class cancel_source
+{
+public:
+	explicit cancel_source(cancel_source *_parent = nullptr, std::size_t refs = 1) :
+		parent(_parent), m_requested(false), m_refs(refs), m_parked(nullptr), m_children(nullptr), m_prev(nullptr), m_next(nullptr)
+	{
+		if (!parent)
+			return;
+
+		parent->retain();
+
+		std::lock_guard<std::mutex> lock(parent->m_lock);
+		m_next = parent->m_children;
+		if (m_next)
+			m_next->m_prev = this;
+		parent->m_children = this;
+	}
+
+	virtual ~cancel_source()
+	{
+		if (!parent)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(parent->m_lock);
+			if (m_prev)
+				m_prev->m_next = m_next;
+			else
+				parent->m_children = m_next;
+			if (m_next)
+				m_next->m_prev = m_prev;
+		}
+
+		parent->release();
+	}
+
+	cancel_source(const cancel_source &) = delete;
+	cancel_source &operator=(const cancel_source &) = delete;
+
+	void retain(void) { m_refs.fetch_add(1, std::memory_order_relaxed); }
+
+	void release(void)
+	{
+		if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete this;
+	}
+
+	/* @brief 请求取消, 可在任意线程调用, 重复调用没有影响 */
+	void request(void);
+
+	bool is_requested(void) const
+	{
+		for (const cancel_source *s = this; s; s = s->parent)
+			if (s->m_requested.load(std::memory_order_acquire))
+				return true;
+		return false;
+	}
+
+	/*
+	 * @brief 协程开始等待IO, 在锁内调用 arm() 注册IO事件并挂入等待列表
+	 *        注册和挂入之间不能被取消, 否则IO线程注销fd后这里又重新注册了已被唤醒的协程
+	 * @return 已被取消时不注册, 返回false
+	 */
+	template <typename F>
+	bool park(netio_task::promise_type &p, F &&arm)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		if (is_requested())
+			return false;
+
+		arm();
+
+		p.park_prev = nullptr;
+		p.park_next = m_parked;
+		if (m_parked)
+			m_parked->park_prev = &p;
+		m_parked = &p;
+		p.parked = true;
+		return true;
+	}
+
+	/* @brief IO事件发生, 从等待列表中取走协程; 返回false表示已被 request() 取走, 应忽略该事件 */
+	bool unpark(netio_task::promise_type &p)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		if (!p.parked)
+			return false;
+
+		unlink(p);
+		return true;
+	}
+
+public:
+	cancel_source *const parent;
+
+private:
+	/* @brief 从等待列表中移除, 需持有 m_lock */
+	void unlink(netio_task::promise_type &p)
+	{
+		if (p.park_prev)
+			p.park_prev->park_next = p.park_next;
+		else
+			m_parked = p.park_next;
+		if (p.park_next)
+			p.park_next->park_prev = p.park_prev;
+		p.parked = false;
+	}
+
+private:
+	std::atomic<bool> m_requested;
+	std::atomic<std::size_t> m_refs;
+
+	std::mutex m_lock;                /* @brief 保护等待列表和子取消来源列表 */
+	netio_task::promise_type *m_parked;  /* @brief 正在等待IO的协程 */
+	cancel_source *m_children;        /* @brief 以本对象为 parent 的取消来源 */
+	cancel_source *m_prev;            /* @brief 在 parent 的子取消来源列表中的前后位置 */
+	cancel_source *m_next;
+};
+
+inline netio_task::promise_type::~promise_type()
+{
+	NAKU_PROBE1(co_destroy, std::coroutine_handle<promise_type>::from_promise(*this).address());
+	if (cancel)
+		cancel->release();
+}
+
+inline bool netio_task::promise_type::cancelled(void) const
+{
+	return cancel && cancel->is_requested();
+}
+
+/*
+ * @brief 取消令牌, 用 co_run(token, f, args...) 绑定到协程; 可绑定多个协程, 拷贝的令牌共享同一个取消请求
+ *        cancel() 后, 绑定的协程正在等待的IO立即返回 -1, errno 为 ECANCELED, fd 从 epoll 中注销, 之后的IO操作也是如此
+ *        协程按IO出错的正常路径结束, 协程帧和其中的资源随之释放
+ */
+class cancel_token
+{
+public:
+	cancel_token() : m_source(new cancel_source()) {}
+	cancel_token(const cancel_token &t) : m_source(t.m_source) { m_source->retain(); }
+	cancel_token &operator=(const cancel_token &t)
+	{
+		t.m_source->retain();
+		m_source->release();
+		m_source = t.m_source;
+		return *this;
+	}
+	~cancel_token() { m_source->release(); }
+
+	/* @brief 取消绑定的所有协程, 可在任意线程调用 */
+	void cancel(void) const { m_source->request(); }
+
+	bool cancelled(void) const { return m_source->is_requested(); }
+
+	/* @brief 绑定到尚未开始运行的协程 */
+	void attach(netio_task task) const
+	{
+		auto &p = task.handle_.promise();
+
+		m_source->retain();
+		if (p.cancel)
+			p.cancel->release();
+		p.cancel = m_source;
+	}
+
+private:
+	cancel_source *m_source;
+};
+
 } } // namespace
 
 #endif // NAKU_NETIO_TASK_H
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <climits>
 #include <cerrno>
 #include <cstring>
 
@@ -10,16 +11,22 @@
 #include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #ifdef HTTPS_SUPPORT
+#include <algorithm>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #endif
 
 #include <naku/base/copool/netio_task.h>
+#include <naku/base/copool/admission.h>
+#include <naku/base/copool/run_budget.h>
+#include <naku/base/utils/buffer_pool.h>
 
 namespace naku { namespace base {
 
@@ -29,7 +36,10 @@ static inline int naku_socket(int domain, int type, int protocol)
 	return socket(domain, type | SOCK_NONBLOCK, protocol);
 }
 
-/* @brief 封装bind, listen接口 */
+/* @brief 封装bind, listen接口
+ * backlog 使用 INT_MAX, 内核会截断为 net.core.somaxconn; 旧的头文件中 SOMAXCONN 只有128, 会限制调大的 somaxconn
+ * 全连接队列满时新的SYN被丢弃, 客户端要等1秒后重传, 大量连接同时到来时队列过短会使建连速度降到每秒一个队列长度
+ */
 static inline int naku_listen(int fd, uint32_t ipaddr, uint16_t port)
 {
 	int ret;
@@ -44,21 +54,54 @@ static inline int naku_listen(int fd, uint32_t ipaddr, uint16_t port)
 	if (ret == -1)
 		return ret;
 
-	ret = listen(fd, 128);
+	ret = listen(fd, INT_MAX);
+	if (ret == -1)
+		return ret;
+
+	return 0;
+}
+
+/* @brief 封装bind, listen接口, 用于AF_UNIX等非IPv4地址 */
+static inline int naku_listen(int fd, const sockaddr *addr, socklen_t addrlen)
+{
+	int ret;
+
+	ret = bind(fd, addr, addrlen);
+	if (ret == -1)
+		return ret;
+
+	ret = listen(fd, INT_MAX);
 	if (ret == -1)
 		return ret;
 
 	return 0;
 }
 
+/* @brief 主动让出调度线程, 协程被放回所在优先级队列的末尾, 等同优先级的其他协程运行一轮后再继续
+ * 长时间计算的协程应当定期 co_await 它; 下面的IO操作在 run_budget 用完时也会以同样的方式让出
+ */
+class async_yield {
+public:
+    bool await_ready() { return false; }
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		handle.promise().root().run_state = CO_YIELD;
+	}
+
+    void await_resume() {}
+};
+
 /* @brief 封装connect过程
- * 1. 当connect没有立刻完成时, 挂起协程, 等待EPOLLOUT事件
- * 2. 当事件发生时, 连接成功
+ * 1. 当connect返回EINPROGRESS时, 挂起协程, 等待EPOLLOUT事件
+ * 2. 当事件发生时, 由 SO_ERROR 取得连接结果, 失败时返回-1, errno 为连接的错误码
+ * 3. EAGAIN 不是正在进行的连接: AF_UNIX 为对端监听队列已满, tcp 为本地端口耗尽, 没有建立连接, 直接返回-1
  */
 class async_connect {
 public:
 	async_connect(int fd, sockaddr *addr, socklen_t addrlen) : 
-				m_fd(fd), m_addr(addr), m_addrlen(addrlen), m_need_suspend(false) {}
+				m_fd(fd), m_addr(addr), m_addrlen(addrlen), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
 
     bool await_ready()
 	{
@@ -67,7 +110,7 @@ public:
 			m_ret = connect(m_fd, m_addr, m_addrlen);
 			if (m_ret == -1)
 			{
-				if (errno == EAGAIN || errno == EINPROGRESS)
+				if (errno == EINPROGRESS)
 				{
 					m_need_suspend = true;
 					return false;
@@ -77,21 +120,55 @@ public:
 					continue;
 			}
 
-			return true;
+			m_yield = run_budget::consume();
+			return !m_yield;
 		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = EPOLLOUT;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLOUT;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
 		if (m_need_suspend)
+		{
+			int err = 0;
+			socklen_t len = sizeof(err);
+
+			if (getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+				return -1;
+			if (err != 0)
+			{
+				errno = err;
+				return -1;
+			}
 			return 0;
+		}
 		return m_ret;
 	}
 
@@ -101,15 +178,30 @@ private:
 	sockaddr *m_addr;
 	socklen_t m_addrlen;
 	bool      m_need_suspend;
+	bool      m_yield;
+	bool      m_cancelled;
 };
 
+/* @brief 封装accept过程
+ * 1. 没有新连接时, 挂起协程, 等待EPOLLIN事件
+ * 2. 协程池已满时不调用accept, 挂起协程直到协程池有空余容量, 再等待EPOLLIN事件
+ *    throttle 为false时不受限制, 用于统计计数等管理接口, 过载时也需要能访问
+ */
 class async_accept {
 public:
-	async_accept(int fd, sockaddr* addr, socklen_t *addrlen) : 
-		m_fd(fd), m_connfd(-1), m_need_suspend(false), m_addr(addr), m_addrlen(addrlen) {}
+	async_accept(int fd, sockaddr* addr, socklen_t *addrlen, bool throttle = true) : 
+		m_fd(fd), m_connfd(-1), m_need_suspend(false), m_yield(false), m_cancelled(false), m_throttle(throttle), m_throttled(false),
+		m_addr(addr), m_addrlen(addrlen) {}
 
     bool await_ready()
 	{
+		if (m_throttle && admission::paused().load(std::memory_order_relaxed))
+		{
+			m_need_suspend = true;
+			m_throttled = true;
+			return false;
+		}
+
 		for (;;)
 		{
 			m_connfd = accept4(m_fd, m_addr, m_addrlen, SOCK_NONBLOCK);		
@@ -125,19 +217,41 @@ public:
 					continue;
 			}
 
-			return true; // dont't suspend
+			m_yield = run_budget::consume();
+			return !m_yield;
 		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = EPOLLIN;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLIN;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = m_throttled ? CO_THROTTLED : CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
 		if (!m_need_suspend)
 			return m_connfd;
 
@@ -158,6 +272,10 @@ private:
 	int     	m_fd;
 	int         m_connfd;
 	bool        m_need_suspend;
+	bool        m_yield;
+	bool        m_cancelled;
+	bool        m_throttle;
+	bool        m_throttled;
 	sockaddr   *m_addr;
 	socklen_t  *m_addrlen;
 };
@@ -166,7 +284,7 @@ private:
 class async_read {
 public:
 	async_read(int fd, void *buf, size_t len) : 
-			m_fd(fd), m_buf(buf), m_len(len), m_need_suspend(false) {}
+			m_fd(fd), m_buf(buf), m_len(len), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
 
     bool await_ready()
 	{
@@ -185,19 +303,41 @@ public:
 					continue;
 			}
 
-			return true;
+			m_yield = run_budget::consume();
+			return !m_yield;
 		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = EPOLLIN;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLIN;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
 		if (!m_need_suspend)
 			return m_nbytes;
 
@@ -220,12 +360,114 @@ private:
 	size_t  m_len;
 	ssize_t m_nbytes;
 	bool    m_need_suspend;
+	bool    m_yield;
+	bool    m_cancelled;
+};
+
+/* @brief 使用共享接收缓冲区的read
+ * 1. 只在fd可读时从当前调度线程的 buffer_pool 借用缓冲区, 没有数据(EAGAIN)时立即归还再挂起
+ *    等待数据的空闲连接不占用缓冲区内存
+ * 2. 返回值大于0时数据在 buf 中, 长度为 buf.size(), 处理完后调用者应尽快 buf.release() 归还
+ *    返回值小于等于0时缓冲区已归还
+ */
+class async_read_pooled {
+public:
+	async_read_pooled(int fd, pooled_buf &buf) : 
+			m_fd(fd), m_buf(buf), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		for (;;)
+		{
+			m_nbytes = read(m_fd, m_buf.acquire(), m_buf.capacity());
+			if (m_nbytes == -1)
+			{
+				if (errno == EAGAIN)
+				{
+					m_buf.release();
+					m_need_suspend = true;
+					return false;
+				}
+				
+				if (errno == EINTR)
+					continue;
+			}
+
+			filled();
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLIN;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nbytes;
+
+		for (;;)
+		{
+			m_nbytes = read(m_fd, m_buf.acquire(), m_buf.capacity());
+			if (m_nbytes == -1)
+			{
+				if (errno == EINTR)
+					continue;
+			}
+
+			filled();
+			return m_nbytes;
+		}
+	}
+
+private:
+	void filled(void)
+	{
+		if (m_nbytes > 0)
+			m_buf.resize(m_nbytes);
+		else
+			m_buf.release();
+	}
+
+private:
+	int          m_fd;
+	pooled_buf  &m_buf;
+	ssize_t      m_nbytes;
+	bool         m_need_suspend;
+	bool         m_yield;
+	bool         m_cancelled;
 };
 
 class async_write {
 public:
 	async_write(int fd, void *buf, size_t len) : 
-				m_fd(fd), m_buf(buf), m_len(len), m_need_suspend(false) {}
+				m_fd(fd), m_buf(buf), m_len(len), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
 
     bool await_ready()
 	{
@@ -244,19 +486,41 @@ public:
 					continue;
 			}
 
-			return true;
+			m_yield = run_budget::consume();
+			return !m_yield;
 		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = EPOLLOUT;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLOUT;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
 		if (!m_need_suspend)
 			return m_nbytes;
 
@@ -279,180 +543,916 @@ private:
 	size_t  m_len;
 	ssize_t m_nbytes;
 	bool    m_need_suspend;
+	bool    m_yield;
+	bool    m_cancelled;
 };
 
-#ifdef HTTPS_SUPPORT
-/* ssl */
-class async_sslconnect {
+/* @brief 封装sendfile, 文件数据在内核中直接发送到socket, 不经过用户态缓冲区
+ *        offset 为NULL时使用并更新文件偏移, 否则更新 *offset
+ *        socket 开启kTLS后, sendfile 发送的数据同样由内核加密
+ */
+class async_sendfile {
 public:
-	async_sslconnect(SSL *ssl, int fd) : 
-				m_fd(fd), m_ssl(ssl), m_need_suspend(false) {}
+	async_sendfile(int fd, int infd, off_t *offset, size_t count) : 
+				m_fd(fd), m_infd(infd), m_offset(offset), m_count(count), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
 
     bool await_ready()
 	{
-		int err;
-
 		for (;;)
 		{
-			m_ret = SSL_connect(m_ssl);
-			if (m_ret <= 0)
+			m_nbytes = sendfile(m_fd, m_infd, m_offset, m_count);
+			if (m_nbytes == -1)
 			{
-				err = SSL_get_error(m_ssl, m_ret);
-				if (err == SSL_ERROR_WANT_WRITE)
-				{
-					m_need_suspend = true;
-					m_flag = EPOLLOUT;
-					return false;
-				}
-				else if (err == SSL_ERROR_WANT_READ)
+				if (errno == EAGAIN)
 				{
 					m_need_suspend = true;
-					m_flag = EPOLLIN;
 					return false;
 				}
+
+				if (errno == EINTR)
+					continue;
 			}
 
-			return true;
+			m_yield = run_budget::consume();
+			return !m_yield;
 		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = m_flag;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLOUT;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
-		int err;
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
 
 		if (!m_need_suspend)
-			return m_ret;
+			return m_nbytes;
 
-		m_ret = ::SSL_connect(m_ssl);
-		if (m_ret <= 0)
+		for (;;)
 		{
-			err = SSL_get_error(m_ssl, m_ret);
-			if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+			m_nbytes = sendfile(m_fd, m_infd, m_offset, m_count);
+			if (m_nbytes == -1)
 			{
-				return 0;
+				if (errno == EINTR)
+					continue;
 			}
-		}
 
-		return m_ret;
+			return m_nbytes;
+		}
 	}
 
 private:
-	int       m_flag;
-	int       m_ret;
-	int       m_fd;
-	SSL      *m_ssl;
-	bool      m_need_suspend;
+	int     m_fd;
+	int     m_infd;
+	off_t * m_offset;
+	size_t  m_count;
+	ssize_t m_nbytes;
+	bool    m_need_suspend;
+	bool    m_yield;
+	bool    m_cancelled;
 };
 
-class async_sslread {
+/* @brief 封装splice, 在 fd_in 和 fd_out 之间(其中一个是管道)移动数据, 不经过用户态缓冲区
+ *        管道两端需为非阻塞; EAGAIN 时等待 wait_fd 上的 events(读socket时为 socket 的 EPOLLIN, 写socket时为 socket 的 EPOLLOUT)
+ *        返回0表示 fd_in 读到了文件结束(对端关闭写)
+ */
+class async_splice {
 public:
-	async_sslread(SSL *ssl, int fd, void *buf, size_t len) : 
-			m_fd(fd), m_buf(buf), m_ssl(ssl), m_len(len), m_need_suspend(false) {}
+	async_splice(int fd_in, int fd_out, size_t len, int wait_fd, uint32_t events) : 
+				m_in(fd_in), m_out(fd_out), m_len(len), m_wait_fd(wait_fd), m_events(events),
+				m_need_suspend(false), m_yield(false), m_cancelled(false) {}
 
     bool await_ready()
 	{
-		int err;
-
 		for (;;)
 		{
-			m_nbytes = SSL_read(m_ssl, m_buf, m_len);
-			if (m_nbytes <= 0)
+			m_nbytes = splice(m_in, NULL, m_out, NULL, m_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (m_nbytes == -1)
 			{
-				err = SSL_get_error(m_ssl, m_nbytes);
-				if (err == SSL_ERROR_WANT_WRITE)
-				{
-					m_need_suspend = true;
-					m_flag = EPOLLOUT;
-					return false;
-				}
-				if (err == SSL_ERROR_WANT_READ)
+				if (errno == EAGAIN)
 				{
 					m_need_suspend = true;
-					m_flag = EPOLLIN;
 					return false;
 				}
+
+				if (errno == EINTR)
+					continue;
 			}
 
-			return true;
+			m_yield = run_budget::consume();
+			return !m_yield;
 		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = m_flag;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_wait_fd;
+		handle.promise().root().events = m_events;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
 		if (!m_need_suspend)
 			return m_nbytes;
 
-		return ::SSL_read(m_ssl, m_buf, m_len);
+		for (;;)
+		{
+			m_nbytes = splice(m_in, NULL, m_out, NULL, m_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (m_nbytes == -1)
+			{
+				if (errno == EINTR)
+					continue;
+			}
+
+			return m_nbytes;
+		}
 	}
 
 private:
-	int     m_fd;
-	int     m_flag;
-	void *  m_buf;
-	SSL  *  m_ssl;
-	size_t  m_len;
-	ssize_t m_nbytes;
-	bool    m_need_suspend;
+	int      m_in;
+	int      m_out;
+	size_t   m_len;
+	int      m_wait_fd;
+	uint32_t m_events;
+	ssize_t  m_nbytes;
+	bool     m_need_suspend;
+	bool     m_yield;
+	bool     m_cancelled;
 };
 
-class async_sslwrite {
+/* @brief 封装recvmmsg, 一次系统调用接收多个数据报, 返回实际接收的消息数量 */
+class async_recvmmsg {
 public:
-	async_sslwrite(SSL *ssl, int fd, void *buf, size_t len) : 
-				m_fd(fd), m_buf(buf), m_ssl(ssl), m_len(len), m_need_suspend(false) {}
+	async_recvmmsg(int fd, mmsghdr *msgs, unsigned int vlen, int flags) : 
+			m_fd(fd), m_msgs(msgs), m_vlen(vlen), m_flags(flags), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
 
     bool await_ready()
 	{
-		int err;
-
 		for (;;)
 		{
-			m_nbytes = SSL_write(m_ssl, m_buf, m_len);
-			if (m_nbytes <= 0)
+			m_nmsgs = recvmmsg(m_fd, m_msgs, m_vlen, m_flags, NULL);
+			if (m_nmsgs == -1)
 			{
-				err = SSL_get_error(m_ssl, m_nbytes);
-				if (err == SSL_ERROR_WANT_WRITE)
-				{
-					m_need_suspend = true;
-					m_flag = EPOLLOUT;
-					return false;
-				}
-				if (err == SSL_ERROR_WANT_READ)
+				if (errno == EAGAIN)
 				{
 					m_need_suspend = true;
-					m_flag = EPOLLIN;
 					return false;
 				}
+				
+				if (errno == EINTR)
+					continue;
 			}
-			return true;
-		}
 
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
 	}
 
-    void await_suspend(std::coroutine_handle<netio_task::promise_type> handle)
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
 	{
-		handle.promise().fd = m_fd;
-		handle.promise().events = m_flag;
-		handle.promise().run_state = CO_IOWAIT;
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLIN;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
 	}
 
     ssize_t await_resume()
 	{
-		if (!m_need_suspend)
-			return m_nbytes;
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nmsgs;
+
+		for (;;)
+		{
+			m_nmsgs = recvmmsg(m_fd, m_msgs, m_vlen, m_flags, NULL);
+			if (m_nmsgs == -1)
+			{
+				if (errno == EINTR)
+					continue;
+			}
+
+			return m_nmsgs;
+		}
+	}
+
+private:
+	int          m_fd;
+	mmsghdr *    m_msgs;
+	unsigned int m_vlen;
+	int          m_flags;
+	ssize_t      m_nmsgs;
+	bool         m_need_suspend;
+	bool         m_yield;
+	bool         m_cancelled;
+};
+
+/* @brief 封装sendmmsg, 一次系统调用发送多个数据报, 返回实际发送的消息数量 */
+class async_sendmmsg {
+public:
+	async_sendmmsg(int fd, mmsghdr *msgs, unsigned int vlen, int flags) : 
+			m_fd(fd), m_msgs(msgs), m_vlen(vlen), m_flags(flags), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		for (;;)
+		{
+			m_nmsgs = sendmmsg(m_fd, m_msgs, m_vlen, m_flags);
+			if (m_nmsgs == -1)
+			{
+				if (errno == EAGAIN)
+				{
+					m_need_suspend = true;
+					return false;
+				}
+				
+				if (errno == EINTR)
+					continue;
+			}
+
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLOUT;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nmsgs;
+
+		for (;;)
+		{
+			m_nmsgs = sendmmsg(m_fd, m_msgs, m_vlen, m_flags);
+			if (m_nmsgs == -1)
+			{
+				if (errno == EINTR)
+					continue;
+			}
+
+			return m_nmsgs;
+		}
+	}
+
+private:
+	int          m_fd;
+	mmsghdr *    m_msgs;
+	unsigned int m_vlen;
+	int          m_flags;
+	ssize_t      m_nmsgs;
+	bool         m_need_suspend;
+	bool         m_yield;
+	bool         m_cancelled;
+};
+
+/* @brief 封装sendmsg, 用于携带辅助数据(如SCM_RIGHTS传递fd)的发送 */
+class async_sendmsg {
+public:
+	async_sendmsg(int fd, const msghdr *msg, int flags) : 
+				m_fd(fd), m_msg(msg), m_flags(flags), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		for (;;)
+		{
+			m_nbytes = sendmsg(m_fd, m_msg, m_flags | MSG_NOSIGNAL);
+			if (m_nbytes == -1)
+			{
+				if (errno == EAGAIN)
+				{
+					m_need_suspend = true;
+					return false;
+				}
+
+				if (errno == EINTR)
+					continue;
+			}
+
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLOUT;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nbytes;
+
+		for (;;)
+		{
+			m_nbytes = sendmsg(m_fd, m_msg, m_flags | MSG_NOSIGNAL);
+			if (m_nbytes == -1)
+			{
+				if (errno == EINTR)
+					continue;
+			}
+
+			return m_nbytes;
+		}
+	}
+
+private:
+	int            m_fd;
+	const msghdr * m_msg;
+	int            m_flags;
+	ssize_t        m_nbytes;
+	bool           m_need_suspend;
+	bool           m_yield;
+	bool           m_cancelled;
+};
+
+/* @brief 封装recvmsg, 用于接收辅助数据(如SCM_RIGHTS传递的fd) */
+class async_recvmsg {
+public:
+	async_recvmsg(int fd, msghdr *msg, int flags) : 
+			m_fd(fd), m_msg(msg), m_flags(flags), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		for (;;)
+		{
+			m_nbytes = recvmsg(m_fd, m_msg, m_flags);
+			if (m_nbytes == -1)
+			{
+				if (errno == EAGAIN)
+				{
+					m_need_suspend = true;
+					return false;
+				}
+				
+				if (errno == EINTR)
+					continue;
+			}
+
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = EPOLLIN;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nbytes;
+
+		for (;;)
+		{
+			m_nbytes = recvmsg(m_fd, m_msg, m_flags);
+			if (m_nbytes == -1)
+			{
+				if (errno == EINTR)
+					continue;
+			}
+
+			return m_nbytes;
+		}
+	}
+
+private:
+	int      m_fd;
+	msghdr * m_msg;
+	int      m_flags;
+	ssize_t  m_nbytes;
+	bool     m_need_suspend;
+	bool     m_yield;
+	bool     m_cancelled;
+};
+
+#ifdef HTTPS_SUPPORT
+/* 
+ * @brief kTLS: 握手完成后由内核进行TLS记录的加解密
+ * 1. 必须在握手之前开启, OpenSSL 在握手结束时将会话密钥交给内核(TCP_ULP "tls")
+ *    async_sslconnect 完成后即生效, 无需额外操作
+ * 2. 发送方向卸载到内核后, 可以直接对fd使用 async_write/async_sendfile, 数据由内核加密
+ *    但不能与尚未完成的 SSL_write 交替使用
+ * 3. 内核未加载tls模块, 或协商的加密套件内核不支持时, 握手照常完成, 继续在用户态加解密
+ *    OpenSSL 3.0 对 TLS1.3 只支持发送方向卸载
+ */
+static inline int naku_ssl_ktls_enable(SSL_CTX *ctx)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+	return 0;
+#else
+	(void)ctx;
+	return -1;
+#endif
+}
+
+static inline int naku_ssl_ktls_enable(SSL *ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+	return 0;
+#else
+	(void)ssl;
+	return -1;
+#endif
+}
+
+/* @brief 握手完成后判断发送方向是否已由内核加密 */
+static inline bool naku_ssl_ktls_send(SSL *ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	return BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+	(void)ssl;
+	return false;
+#endif
+}
+
+/* @brief 握手完成后判断接收方向是否已由内核解密 */
+static inline bool naku_ssl_ktls_recv(SSL *ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	return BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#else
+	(void)ssl;
+	return false;
+#endif
+}
+
+/* ssl */
+class async_sslconnect {
+public:
+	async_sslconnect(SSL *ssl, int fd) : 
+				m_fd(fd), m_ssl(ssl), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		int err;
+
+		for (;;)
+		{
+			m_ret = SSL_connect(m_ssl);
+			if (m_ret <= 0)
+			{
+				err = SSL_get_error(m_ssl, m_ret);
+				if (err == SSL_ERROR_WANT_WRITE)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLOUT;
+					return false;
+				}
+				else if (err == SSL_ERROR_WANT_READ)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLIN;
+					return false;
+				}
+			}
+
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = m_flag;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		int err;
+
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_ret;
+
+		m_ret = ::SSL_connect(m_ssl);
+		if (m_ret <= 0)
+		{
+			err = SSL_get_error(m_ssl, m_ret);
+			if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+			{
+				return 0;
+			}
+		}
+
+		return m_ret;
+	}
+
+private:
+	int       m_flag;
+	int       m_ret;
+	int       m_fd;
+	SSL      *m_ssl;
+	bool      m_need_suspend;
+	bool      m_yield;
+	bool      m_cancelled;
+};
+
+/* @brief 服务端TLS握手, 与 async_sslconnect 相同, 返回0表示握手尚未完成, 需再次co_await
+ *        SSL_CTX 开启kTLS时, 握手完成后会话密钥同样交给内核
+ */
+class async_sslaccept {
+public:
+	async_sslaccept(SSL *ssl, int fd) : 
+				m_fd(fd), m_ssl(ssl), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		int err;
+
+		for (;;)
+		{
+			m_ret = SSL_accept(m_ssl);
+			if (m_ret <= 0)
+			{
+				err = SSL_get_error(m_ssl, m_ret);
+				if (err == SSL_ERROR_WANT_WRITE)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLOUT;
+					return false;
+				}
+				else if (err == SSL_ERROR_WANT_READ)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLIN;
+					return false;
+				}
+			}
+
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = m_flag;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		int err;
+
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_ret;
+
+		m_ret = ::SSL_accept(m_ssl);
+		if (m_ret <= 0)
+		{
+			err = SSL_get_error(m_ssl, m_ret);
+			if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+			{
+				return 0;
+			}
+		}
+
+		return m_ret;
+	}
+
+private:
+	int       m_flag;
+	int       m_ret;
+	int       m_fd;
+	SSL      *m_ssl;
+	bool      m_need_suspend;
+	bool      m_yield;
+	bool      m_cancelled;
+};
+
+class async_sslread {
+public:
+	async_sslread(SSL *ssl, int fd, void *buf, size_t len) : 
+			m_fd(fd), m_buf(buf), m_ssl(ssl), m_len(len), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		int err;
+
+		for (;;)
+		{
+			m_nbytes = SSL_read(m_ssl, m_buf, m_len);
+			if (m_nbytes <= 0)
+			{
+				err = SSL_get_error(m_ssl, m_nbytes);
+				if (err == SSL_ERROR_WANT_WRITE)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLOUT;
+					return false;
+				}
+				if (err == SSL_ERROR_WANT_READ)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLIN;
+					return false;
+				}
+			}
+
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = m_flag;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nbytes;
+
+		return ::SSL_read(m_ssl, m_buf, m_len);
+	}
+
+private:
+	int     m_fd;
+	int     m_flag;
+	void *  m_buf;
+	SSL  *  m_ssl;
+	size_t  m_len;
+	ssize_t m_nbytes;
+	bool    m_need_suspend;
+	bool    m_yield;
+	bool    m_cancelled;
+};
+
+class async_sslwrite {
+public:
+	async_sslwrite(SSL *ssl, int fd, void *buf, size_t len) : 
+				m_fd(fd), m_buf(buf), m_ssl(ssl), m_len(len), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		int err;
+
+		for (;;)
+		{
+			m_nbytes = SSL_write(m_ssl, m_buf, m_len);
+			if (m_nbytes <= 0)
+			{
+				err = SSL_get_error(m_ssl, m_nbytes);
+				if (err == SSL_ERROR_WANT_WRITE)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLOUT;
+					return false;
+				}
+				if (err == SSL_ERROR_WANT_READ)
+				{
+					m_need_suspend = true;
+					m_flag = EPOLLIN;
+					return false;
+				}
+			}
+			m_yield = run_budget::consume();
+			return !m_yield;
+		}
+
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = m_flag;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nbytes;
 
 		return ::SSL_write(m_ssl, m_buf, m_len);
 	}
@@ -465,6 +1465,120 @@ private:
 	size_t  m_len;
 	ssize_t m_nbytes;
 	bool    m_need_suspend;
+	bool    m_yield;
+	bool    m_cancelled;
+};
+
+/* @brief 通过TLS连接发送文件
+ * 1. 发送方向已卸载到内核(kTLS)时使用 SSL_sendfile, 零拷贝
+ * 2. 否则回退为 pread 到用户态缓冲区后 SSL_write, 每次最多发送一个缓冲区
+ * 返回本次发送的字节数, 调用者负责推进 offset 并循环发送
+ */
+class async_sslsendfile {
+public:
+	static constexpr size_t bufsize = pooled_buf::capacity(); /* 一个TLS记录的最大明文长度 */
+
+	async_sslsendfile(SSL *ssl, int fd, int infd, off_t offset, size_t count) : 
+				m_fd(fd), m_infd(infd), m_ssl(ssl), m_offset(offset), m_count(count),
+				m_pending(0), m_need_suspend(false), m_yield(false), m_cancelled(false) {}
+
+    bool await_ready()
+	{
+		int err;
+
+		if (!naku_ssl_ktls_send(m_ssl))
+		{
+			/* 从当前调度线程的 buffer_pool 借用, 不在每次发送时分配 */
+			m_pending = pread(m_infd, m_buf.acquire(), std::min(m_count, bufsize), m_offset);
+			if (m_pending <= 0)
+			{
+				m_nbytes = m_pending;
+				return true;
+			}
+		}
+
+		m_nbytes = send();
+		if (m_nbytes <= 0)
+		{
+			err = SSL_get_error(m_ssl, m_nbytes);
+			if (err == SSL_ERROR_WANT_WRITE)
+			{
+				m_need_suspend = true;
+				m_flag = EPOLLOUT;
+				return false;
+			}
+			if (err == SSL_ERROR_WANT_READ)
+			{
+				m_need_suspend = true;
+				m_flag = EPOLLIN;
+				return false;
+			}
+		}
+
+		m_yield = run_budget::consume();
+		return !m_yield;
+	}
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		if (m_yield)
+		{
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		if (handle.promise().root().cancelled())
+		{
+			m_cancelled = true;
+			handle.promise().root().run_state = CO_YIELD;
+			return;
+		}
+
+		handle.promise().root().fd = m_fd;
+		handle.promise().root().events = m_flag;
+		handle.promise().root().wait_cancelled = &m_cancelled;
+		handle.promise().root().run_state = CO_IOWAIT;
+	}
+
+    ssize_t await_resume()
+	{
+		if (m_cancelled)
+		{
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (!m_need_suspend)
+			return m_nbytes;
+
+		return send();
+	}
+
+private:
+	/* @brief SSL_write 重试时必须使用相同的缓冲区和长度 */
+	ssize_t send(void)
+	{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+		if (m_buf.empty())
+			return ::SSL_sendfile(m_ssl, m_infd, m_offset, m_count, 0);
+#endif
+		return ::SSL_write(m_ssl, m_buf.data(), m_pending);
+	}
+
+private:
+	int     m_fd;
+	int     m_flag;
+	int     m_infd;
+	SSL  *  m_ssl;
+	off_t   m_offset;
+	size_t  m_count;
+	ssize_t m_pending;
+	ssize_t m_nbytes;
+	bool    m_need_suspend;
+	bool    m_yield;
+	bool    m_cancelled;
+	pooled_buf m_buf;
 };
 
 #endif // HTTPS_SUPPORT
@@ -0,0 +1,75 @@
+#ifndef NAKU_REGISTRY_H
+#define NAKU_REGISTRY_H
+
+#include <mutex>
+#include <cstddef>
+
+#include <naku/base/copool/netio_task.h>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 调度线程的存活协程登记表, 用于 netco_pool::dump 查看每个协程当前的状态
+ * 1. 侵入式双向链表, 链表指针是 promise 的 reg_prev/reg_next, 登记和注销不分配内存
+ * 2. 只在协程被调度线程取走和结束时加锁, 锁只与 dump 竞争; 协程挂起恢复不经过登记表
+ * 3. for_each 在锁内访问协程, 协程注销前不会被销毁; 读取的状态由调度线程写入, 只是某一时刻的近似值
+ */
+class coroutine_registry
+{
+public:
+	coroutine_registry() : head(nullptr), n(0) {}
+
+	coroutine_registry(const coroutine_registry &) = delete;
+	coroutine_registry &operator=(const coroutine_registry &) = delete;
+
+	void add(netio_task::promise_type *p)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		p->reg_prev = nullptr;
+		p->reg_next = head;
+		if (head)
+			head->reg_prev = p;
+		head = p;
+		n++;
+	}
+
+	void remove(netio_task::promise_type *p)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		if (p->reg_prev)
+			p->reg_prev->reg_next = p->reg_next;
+		else
+			head = p->reg_next;
+		if (p->reg_next)
+			p->reg_next->reg_prev = p->reg_prev;
+		p->reg_prev = p->reg_next = nullptr;
+		n--;
+	}
+
+	/* @brief 对每个登记的协程调用 f(promise_type &), f 只能读取协程状态, 不能再访问登记表 */
+	template <typename F>
+	void for_each(F &&f)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		for (netio_task::promise_type *p = head; p != nullptr; p = p->reg_next)
+			f(*p);
+	}
+
+	std::size_t size(void)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return n;
+	}
+
+private:
+	std::mutex m_lock;
+	netio_task::promise_type *head;
+	std::size_t n;
+};
+
+} } // namespace
+
+#endif // NAKU_REGISTRY_H
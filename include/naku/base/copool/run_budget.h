@@ -0,0 +1,42 @@
+#ifndef NAKU_RUN_BUDGET_H
+#define NAKU_RUN_BUDGET_H
+
+namespace naku { namespace base {
+
+/*
+ * @brief 协程每次被恢复运行时的预算, 按立即完成的IO操作次数计算
+ * 1. 调度线程在每次 resume 前调用 reset() 设置预算
+ * 2. IO操作没有挂起就完成时调用 consume(), 预算用完后该操作的 co_await 也会挂起协程(CO_YIELD), 让出调度线程
+ *    否则一个数据源源不断的连接可以一直读写而不挂起, 饿死同一调度线程上的其他协程
+ * 3. 非调度线程上预算为-1, 不受限制
+ */
+class run_budget
+{
+public:
+	/* @param n 预算, 0 表示不限制 */
+	static void reset(unsigned int n) { left() = n ? (int)n : -1; }
+
+	/* @brief 消耗一次预算, 返回true表示预算已用完, 应当让出 */
+	static bool consume(void)
+	{
+		int &l = left();
+
+		if (l < 0)
+			return false;
+		if (l > 0)
+			l--;
+
+		return l == 0;
+	}
+
+private:
+	static int &left(void)
+	{
+		static thread_local int l = -1;
+		return l;
+	}
+};
+
+} } // namespace
+
+#endif // NAKU_RUN_BUDGET_H
@@ -0,0 +1,109 @@
+#ifndef NAKU_STATS_H
+#define NAKU_STATS_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <naku/base/utils/histogram.h>
+#include <naku/base/copool/netio_task.h>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 计数器只由所属线程写入, 其他线程只读
+ *        使用 relaxed 的 load + store 而非 fetch_add, 不产生带锁前缀的原子指令, 开销与普通变量相当
+ */
+static inline void stat_add(std::atomic<uint64_t> &c, uint64_t n = 1)
+{
+	c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static inline void stat_set(std::atomic<uint64_t> &c, uint64_t n)
+{
+	c.store(n, std::memory_order_relaxed);
+}
+
+static inline uint64_t stat_get(const std::atomic<uint64_t> &c)
+{
+	return c.load(std::memory_order_relaxed);
+}
+
+/* @brief 调度线程的计数器, 按缓存行对齐, 避免不同线程的计数器伪共享 */
+struct alignas(64) sched_stats
+{
+	std::atomic<uint64_t> resumes{0};   /* @brief 累计resume次数 */
+	std::atomic<uint64_t> passes{0};    /* @brief 累计轮循调度次数 */
+	std::atomic<uint64_t> ready{0};     /* @brief 上一轮调度时可运行的协程数量 */
+	std::atomic<uint64_t> parks{0};     /* @brief 累计因没有任务而阻塞的次数 */
+	std::atomic<uint64_t> park_ns{0};   /* @brief 累计阻塞时间 */
+	std::atomic<uint64_t> spins{0};     /* @brief 累计自旋等到任务(避免了阻塞)的次数 */
+	std::atomic<uint64_t> starved{0};   /* @brief 因等待过久被提前运行的低优先级协程数量 */
+	std::atomic<uint64_t> yields{0};    /* @brief 协程主动让出或用完预算的次数 */
+	std::atomic<uint64_t> busy_ns{0};   /* @brief 累计运行协程的时间(墙钟), 包括协程中阻塞调用的时间 */
+	std::atomic<uint64_t> tid{0};       /* @brief 线程ID, 用于读取 /proc 中的调度统计 */
+
+	/* @brief 当前协程本次恢复运行的开始时间(0表示没有协程在运行)和协程帧地址, 由看门狗读取 */
+	std::atomic<uint64_t> slice_start{0};
+	std::atomic<uint64_t> current{0};
+
+	histogram sched_delay;  /* @brief 从可运行到被 rr_sched 恢复运行的时间(ns) */
+	histogram io_wait;      /* @brief 在 CO_IOWAIT 状态等待IO事件的时间(ns) */
+	histogram prio_delay[PRIO_NUM];  /* @brief 按优先级区分的调度延迟(ns) */
+};
+
+/* @brief IO多路复用线程的计数器 */
+struct alignas(64) poll_stats
+{
+	std::atomic<uint64_t> wakeups{0};   /* @brief epoll_wait 返回次数 */
+	std::atomic<uint64_t> events{0};    /* @brief 累计处理的事件数量 */
+	std::atomic<uint64_t> timeouts{0};  /* @brief 超时返回(没有事件)的次数 */
+};
+
+/* @brief 某一时刻单个调度线程的统计快照 */
+struct worker_snapshot
+{
+	std::size_t id;
+	uint64_t live;      /* @brief 未结束的协程数量 */
+	uint64_t ready;
+	uint64_t submitq;   /* @brief 已提交尚未被调度线程取走的协程数量 */
+	uint64_t resumes;
+	uint64_t passes;
+	uint64_t parks;
+	uint64_t park_ns;
+	uint64_t spins;
+	bool shedding;      /* @brief 是否处于CoDel丢弃状态 */
+	uint64_t starved;
+	uint64_t yields;
+	uint64_t busy_ns;
+	bool active;        /* @brief 是否参与分配新协程 */
+	latency_summary sched_delay;
+	latency_summary io_wait;
+};
+
+/* @brief 某一时刻整个协程池的统计快照 */
+struct pool_snapshot
+{
+	std::vector<worker_snapshot> workers;
+	uint64_t wakeups;
+	uint64_t events;
+	uint64_t timeouts;
+
+	uint64_t rejected;      /* @brief 准入控制拒绝创建的协程数量 */
+	uint64_t accept_pause;  /* @brief accept被暂停的次数 */
+	bool paused;            /* @brief 当前accept是否被暂停 */
+	uint64_t long_runs;     /* @brief 看门狗发现协程一次运行超过 watchdog_ms 的次数 */
+	uint64_t io_cancels;    /* @brief 等待IO时被取消, 从epoll注销并唤醒的协程数量 */
+	uint64_t active;        /* @brief 参与分配新协程的调度线程数量 */
+	double io_ratio;        /* @brief adapt_ms 启用时实测的阻塞/CPU时间比例(指数平均), 未测得时为-1 */
+
+	/* @brief 所有调度线程合并后的延迟分布 */
+	latency_summary sched_delay;
+	latency_summary io_wait;
+	latency_summary prio_delay[PRIO_NUM];  /* @brief 按优先级区分的调度延迟 */
+};
+
+} } // namespace
+
+#endif // NAKU_STATS_H
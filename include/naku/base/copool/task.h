@@ -0,0 +1,181 @@
+#ifndef NAKU_TASK_H
+#define NAKU_TASK_H
+
+#include <utility>
+#include <optional>
+#include <coroutine>
+#include <exception>
+
+#include <naku/base/copool/netio_task.h>
+
+namespace naku { namespace base {
+
+template <typename T = void>
+class task;
+
+/*
+ * @brief task<T> 的 promise 中与结果类型无关的部分
+ * 1. root 指向最外层 netio_task 的 promise, 内层协程中的IO操作把等待的fd和状态记录在 root 上
+ * 2. continuation 为 co_await 本协程的外层协程, 本协程结束时直接切换回它(对称转移), 不经过调度线程
+ */
+class task_promise_base
+{
+public:
+	/* @brief 结束时切换回外层协程, 并把 root 正在运行的协程改回外层协程 */
+	class final_awaiter
+	{
+	public:
+		bool await_ready() noexcept { return false; }
+
+		template <typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+		{
+			task_promise_base &p = handle.promise();
+
+			p.m_root->leaf = p.m_continuation;
+			return p.m_continuation;
+		}
+
+		void await_resume() noexcept {}
+	};
+
+public:
+	/* @brief 惰性启动, 被 co_await 时才开始运行 */
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	final_awaiter final_suspend() noexcept { return {}; }
+
+	/* @brief 保存异常, 在外层协程 co_await 处重新抛出 */
+	void unhandled_exception() { m_exception = std::current_exception(); }
+
+	/* @brief 最外层 netio_task 的 promise, IO操作的 await_suspend 通过它设置等待的fd和运行状态 */
+	netio_task::promise_type &root() { return *m_root; }
+
+	/* @brief 被外层协程 co_await 时调用 */
+	void attach(netio_task::promise_type *root, std::coroutine_handle<> continuation)
+	{
+		m_root = root;
+		m_continuation = continuation;
+	}
+
+protected:
+	void rethrow(void)
+	{
+		if (m_exception)
+			std::rethrow_exception(m_exception);
+	}
+
+private:
+	netio_task::promise_type *m_root = nullptr;
+	std::coroutine_handle<> m_continuation;
+	std::exception_ptr m_exception;
+};
+
+template <typename T>
+class task_promise : public task_promise_base
+{
+public:
+	task<T> get_return_object();
+
+	template <typename U = T>
+	void return_value(U &&value) { m_value.emplace(std::forward<U>(value)); }
+
+	/* @brief 取出结果, 只能调用一次 */
+	T result(void)
+	{
+		rethrow();
+		return std::move(*m_value);
+	}
+
+private:
+	std::optional<T> m_value;  /* @brief 结果直接保存在协程帧中, 支持不可拷贝和没有默认构造函数的类型 */
+};
+
+template <>
+class task_promise<void> : public task_promise_base
+{
+public:
+	task<void> get_return_object();
+
+	void return_void() {}
+	void result(void) { rethrow(); }
+};
+
+/*
+ * @brief 返回任意类型结果的协程, 在 netio_task 或另一个 task 中使用: T v = co_await f();
+ * 1. 被 co_await 时才开始运行, 与外层协程在同一调度线程上, 启动和返回都直接切换, 不经过调度队列
+ * 2. 结果保存在协程帧中, co_await 的结果从中移动出来, 不需要额外分配内存; 协程中抛出的异常在 co_await 处重新抛出
+ * 3. 其中的IO操作挂起的是整个协程链, IO事件发生时调度线程恢复最内层的协程
+ * 4. task 持有协程帧, 析构时销毁, 只能移动不能拷贝; 只能 co_await 一次
+ */
+template <typename T>
+class task
+{
+public:
+	using promise_type = task_promise<T>;
+
+	class awaiter
+	{
+	public:
+		explicit awaiter(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+
+		bool await_ready() { return false; }
+
+		template <typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent)
+		{
+			netio_task::promise_type &root = parent.promise().root();
+
+			m_handle.promise().attach(&root, parent);
+			root.leaf = m_handle;
+			return m_handle;
+		}
+
+		T await_resume() { return m_handle.promise().result(); }
+
+	private:
+		std::coroutine_handle<promise_type> m_handle;
+	};
+
+public:
+	explicit task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+	task(task &&t) noexcept : m_handle(std::exchange(t.m_handle, nullptr)) {}
+	task &operator=(task &&t) noexcept
+	{
+		if (this != &t) {
+			if (m_handle)
+				m_handle.destroy();
+			m_handle = std::exchange(t.m_handle, nullptr);
+		}
+		return *this;
+	}
+
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+
+	~task()
+	{
+		if (m_handle)
+			m_handle.destroy();
+	}
+
+	awaiter operator co_await() & { return awaiter(m_handle); }
+	awaiter operator co_await() && { return awaiter(m_handle); }
+
+private:
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+inline task<T> task_promise<T>::get_return_object()
+{
+	return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object()
+{
+	return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+} } // namespace
+
+#endif // NAKU_TASK_H
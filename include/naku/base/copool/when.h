@@ -0,0 +1,172 @@
+#ifndef NAKU_WHEN_H
+#define NAKU_WHEN_H
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <coroutine>
+
+#include <sys/types.h>
+
+#include <naku/base/copool/netio_task.h>
+#include <naku/base/copool/copool.h>
+
+namespace naku { namespace base {
+
+/*
+ * @brief when_all/when_any 的共享状态, 由等待的父协程(awaiter)和各子协程(promise 的 cancel)共同持有, 最后一个释放者销毁
+ * 1. 子协程结束时由其调度线程调用 finish() 记录返回值, 随后销毁子协程帧, 释放其引用
+ * 2. remaining 比需要等待的子协程数量多1, 多出的一次由父协程完全挂起之后(调度线程看到 CO_JOIN)减去
+ *    子协程可能在其他调度线程上运行, 在父协程挂起完成之前就已结束, 此时还不能唤醒父协程
+ * 3. when_any 中第一个结束的子协程请求取消, 其余正在等待IO的子协程立即以 ECANCELED 唤醒, 就绪的在下一次等待IO时返回 ECANCELED
+ *    父协程不等待它们结束, 它们结束时只释放引用
+ */
+class join_state : public cancel_source
+{
+public:
+	join_state(std::size_t n, bool any, cancel_source *parent) :
+		cancel_source(parent), results(n, -1), winner(n), m_remaining((any ? 1 : n) + 1), m_any(any) {}
+
+	/* @brief 子协程 index 结束, 返回值为 value; 返回true时调用者应唤醒父协程 */
+	bool finish(std::size_t index, ssize_t value)
+	{
+		if (m_any) {
+			if (m_decided.exchange(true, std::memory_order_relaxed))
+				return false;
+			winner = index;
+			request();
+		}
+
+		results[index] = value;
+		return arrive();
+	}
+
+	/* @brief 减少一次等待, 返回true表示等待结束 */
+	bool arrive(void) { return m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+public:
+	std::vector<ssize_t> results;  /* @brief 各子协程的返回值, when_any 中只有 winner 的有效 */
+	std::size_t winner;            /* @brief when_any 中第一个结束的子协程序号 */
+	netio_task waiter;             /* @brief 等待的父协程 */
+
+private:
+	std::atomic<std::size_t> m_remaining;
+	std::atomic<bool> m_decided{false};
+	bool m_any;
+};
+
+/*
+ * @brief when_all/when_any 的awaiter
+ *        挂起父协程后将子协程交给调度线程并行运行, 子协程继承父协程的优先级和取消请求
+ */
+class async_join {
+public:
+	async_join(std::vector<netio_task> &&tasks, bool any, long worker = -1) :
+		m_tasks(std::move(tasks)), m_any(any), m_worker(worker), m_state(nullptr) {}
+
+	async_join(const async_join &) = delete;
+	async_join &operator=(const async_join &) = delete;
+
+	~async_join()
+	{
+		if (m_state)
+			m_state->release();
+	}
+
+    bool await_ready() { return m_tasks.empty(); }
+
+    template <typename P>
+    void await_suspend(std::coroutine_handle<P> handle)
+	{
+		netio_task::promise_type &root = handle.promise().root();
+
+		m_state = new join_state(m_tasks.size(), m_any, root.cancel);
+		m_state->waiter = netio_task::from_promise(root);
+		root.waiting = m_state;
+		root.run_state = CO_JOIN;
+
+		for (std::size_t i = 0; i < m_tasks.size(); i++)
+		{
+			auto &p = m_tasks[i].handle_.promise();
+
+			m_state->retain();
+			if (p.cancel)
+				p.cancel->release();
+			p.joiner = m_state;
+			p.join_index = i;
+			p.cancel = m_state;
+			p.prio = root.prio;
+			netco_pool::get_instance().schedule(m_tasks[i], m_worker);
+		}
+	}
+
+protected:
+	std::vector<netio_task> m_tasks;
+	bool m_any;
+	long m_worker;     /* @brief 子协程运行的调度线程编号, -1 由协程池选择 */
+	join_state *m_state;
+};
+
+/* @brief 等待所有子协程结束, 结果为各子协程的返回值, 顺序与参数相同 */
+class async_when_all : public async_join {
+public:
+	explicit async_when_all(std::vector<netio_task> &&tasks) : async_join(std::move(tasks), false) {}
+
+	std::vector<ssize_t> await_resume()
+	{
+		if (!m_state)
+			return {};
+		return std::move(m_state->results);
+	}
+};
+
+/*
+ * @brief 等待第一个结束的子协程, 结果为 {序号, 返回值}, 没有子协程时序号为0, 返回值为-1
+ *        其余子协程被请求取消, 不等待它们结束
+ */
+class async_when_any : public async_join {
+public:
+	explicit async_when_any(std::vector<netio_task> &&tasks) : async_join(std::move(tasks), true) {}
+
+	std::pair<std::size_t, ssize_t> await_resume()
+	{
+		if (!m_state)
+			return {0, -1};
+		return {m_state->winner, m_state->results[m_state->winner]};
+	}
+};
+
+/*
+ * @brief submit_to 的awaiter: 在编号为 worker 的调度线程上运行协程, 父协程挂起等待其返回值
+ *        子协程结束时由其调度线程唤醒父协程, 交回父协程所在的调度线程; 编号无效时不运行协程, 返回 -1, errno 为 EINVAL
+ */
+class async_submit_to : public async_join {
+public:
+	async_submit_to(std::size_t worker, netio_task task) :
+		async_join(std::vector<netio_task>{task}, false, (long)worker), m_invalid(worker >= netco_pool::get_instance().worker_count())
+	{
+		if (m_invalid)
+		{
+			task.handle_.destroy();
+			m_tasks.clear();
+		}
+	}
+
+	ssize_t await_resume()
+	{
+		if (m_invalid)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		return m_state->results[0];
+	}
+
+private:
+	bool m_invalid;
+};
+
+} } // namespace
+
+#endif // NAKU_WHEN_H
@@ -0,0 +1,64 @@
+#ifndef NAKU_WORKER_LOCAL_H
+#define NAKU_WORKER_LOCAL_H
+
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+#include <naku/base/copool/copool.h>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 每个调度线程一份的数据, 分片模式下每个分片的状态放在这里
+ * 1. local() 返回当前调度线程的一份, 只由该线程访问, 不需要加锁; 访问其他分片用 submit_to 交给其调度线程
+ * 2. 在协程池初始化之后创建, 份数为调度线程数量, 各份按缓存行对齐, 避免伪共享
+ */
+template <typename T>
+class worker_local
+{
+public:
+	/* @brief 每一份都以 args 构造 */
+	template <typename... Args>
+	explicit worker_local(const Args &...args)
+	{
+		std::size_t n = netco_pool::get_instance().worker_count();
+
+		m_slots.reserve(n);
+		for (std::size_t i = 0; i < n; i++)
+			m_slots.emplace_back(args...);
+	}
+
+	worker_local(const worker_local &) = delete;
+	worker_local &operator=(const worker_local &) = delete;
+
+	/*
+	 * @brief 当前调度线程的一份, 只能在调度线程(协程)中调用
+	 *        其他线程中 worker_id() 为-1, 不检查时会越界访问, 调试版本中断言失败
+	 */
+	T &local(void)
+	{
+		assert(netco_pool::worker_id() >= 0);
+		return m_slots[netco_pool::worker_id()].value;
+	}
+
+	/* @brief 编号为 id 的调度线程的一份, 在其他线程中访问时需自行同步 */
+	T &get(std::size_t id) { return m_slots[id].value; }
+
+	std::size_t size(void) const { return m_slots.size(); }
+
+private:
+	struct alignas(64) slot
+	{
+		template <typename... Args>
+		explicit slot(const Args &...args) : value(args...) {}
+
+		T value;
+	};
+
+	std::vector<slot> m_slots;
+};
+
+} } // namespace
+
+#endif // NAKU_WORKER_LOCAL_H
@@ -10,6 +10,7 @@
 
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <naku/base/poller/poller.h>
 #include <naku/base/logger/logger.h>
@@ -21,13 +22,22 @@ class epoller : public poller
 {
 public:
 	/* @brief 创建epoll和销毁 */
-    epoller() : epoll_fd(epoll_create(1))
+    epoller() : epoll_fd(epoll_create(1)), wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
 	{
-		if (epoll_fd == -1) {
+		epoll_event ev;
+
+		if (epoll_fd == -1 || wake_fd == -1) {
 			LOG_FATAL << "Create epoll instance failed : " << strerror(errno) << std::endl;
 		}
+
+		/* 唤醒用的eventfd, 水平触发, data.ptr 指向自身以区别于协程 */
+		ev.events   = EPOLLIN;
+		ev.data.ptr = &wake_fd;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+			LOG_FATAL << "Epoll ADD eventfd failed : " << strerror(errno) << std::endl;
+		}
 	}
-	virtual ~epoller() noexcept override { ::close(epoll_fd); }
+	virtual ~epoller() noexcept override { ::close(wake_fd); ::close(epoll_fd); }
 
 	/* @brief 添加IO事件监控 */
 	virtual int ioevent_add(int fd, uint32_t events, void *pridata) override;
@@ -36,10 +46,14 @@ public:
 	virtual int ioevent_del(int fd) override;
 
 	/* @brief 监控IO事件, 并设置协程运行状态 */
-    virtual int ioevent_handle(void) override;
+    virtual int ioevent_handle(int timeout) override;
+
+	/* @brief 写eventfd唤醒epoll_wait */
+	virtual void wakeup(void) override;
 
 private:
     int epoll_fd;
+    int wake_fd;
 };
 
 } } // namespace
@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <functional>
 
+#include <naku/base/copool/stats.h>
+
 namespace naku { namespace base {
 
 /* @brief 抽象类poller */
@@ -14,9 +16,15 @@ public:
 
 	void set_callback(std::function<void(void*)> _c) { callback = _c; }
 
+	/* @brief 统计计数由监控线程写入, 其他线程可随时读取 */
+	const poll_stats &get_stats(void) const { return stats; }
+
 	virtual int ioevent_add(int fd, uint32_t, void *pridata) = 0;
 	virtual int ioevent_del(int) = 0;
-	virtual int ioevent_handle(void) = 0;
+	/* @param timeout 等待事件的超时时间(ms), -1 一直等待直到有事件或 wakeup(), 0 不等待(忙轮询) */
+	virtual int ioevent_handle(int timeout) = 0;
+	/* @brief 唤醒阻塞在 ioevent_handle 中的线程, 可在任意线程调用 */
+	virtual void wakeup(void) = 0;
 	/* 
 	 * 虽然析构函数可以是纯虚函数, 但也要提供实现
 	 * 因此直接写成虚函数, 而非纯虚函数
@@ -24,6 +32,7 @@ public:
     virtual ~poller() {};
 protected:
 	std::function<void(void*)> callback;
+	poll_stats stats;
 };
 
 } } // namespace
@@ -0,0 +1,98 @@
+#ifndef NAKU_SSL_CACHE_H
+#define NAKU_SSL_CACHE_H
+
+#ifdef HTTPS_SUPPORT
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 服务端TLS会话缓存, 用于会话恢复(跳过完整的密钥交换)
+ * 1. 关闭 OpenSSL 内部的全局会话缓存(一把锁), 通过回调存取本缓存
+ * 2. 按会话ID哈希分片, 每个分片一把锁和一个LRU链表, 减少多个调度线程握手时的锁竞争
+ * 3. TLS1.2 的会话ID和 TLS1.3 的有状态票据(stateless_tickets = false)都保存在本缓存中
+ *    无状态票据由 OpenSSL 使用 SSL_CTX 的票据密钥加密后交给客户端保存, 不占用服务端内存
+ */
+class ssl_session_cache
+{
+public:
+	/*
+	 * @param nshards  分片数量
+	 * @param capacity 最多缓存的会话数量, 平均分配到各个分片
+	 * @param timeout  会话有效期(秒)
+	 */
+	ssl_session_cache(size_t nshards = 16, size_t capacity = 20480, long timeout = 300);
+	~ssl_session_cache();
+
+	/* @brief 禁用拷贝和移动, SSL_CTX 中保存了本对象的地址 */
+	ssl_session_cache(const ssl_session_cache &) = delete;
+	ssl_session_cache &operator=(const ssl_session_cache &) = delete;
+
+public:
+	/* @brief 安装到 SSL_CTX, 本对象的生命周期必须长于 SSL_CTX */
+	int attach(SSL_CTX *ctx, bool stateless_tickets = true);
+
+	/* @brief 当前缓存的会话数量 */
+	size_t size(void);
+
+	/* @brief 会话恢复命中/未命中次数 */
+	uint64_t hits(void) const {return nhits.load(std::memory_order_relaxed);}
+	uint64_t misses(void) const {return nmisses.load(std::memory_order_relaxed);}
+
+private:
+	struct entry
+	{
+		SSL_SESSION *sess;
+		std::list<std::string>::iterator lru;
+	};
+
+	struct shard
+	{
+		std::mutex lock;
+		std::list<std::string> lru; /* 头部为最近使用 */
+		std::unordered_map<std::string, entry> map;
+	};
+
+	shard &get_shard(const std::string &id);
+	void insert(SSL_SESSION *sess);
+	SSL_SESSION *lookup(const unsigned char *id, int len);
+	void remove(SSL_SESSION *sess);
+
+	/* @brief OpenSSL 回调, 通过 SSL_CTX 的 ex_data 找到缓存对象 */
+	static int new_cb(SSL *ssl, SSL_SESSION *sess);
+	static SSL_SESSION *get_cb(SSL *ssl, const unsigned char *id, int len, int *copy);
+	static void remove_cb(SSL_CTX *ctx, SSL_SESSION *sess);
+	static int ex_index(void);
+
+private:
+	size_t shard_capacity;
+	long   timeout;
+	std::vector<std::unique_ptr<shard>> shards;
+	std::atomic<uint64_t> nhits;
+	std::atomic<uint64_t> nmisses;
+};
+
+/*
+ * @brief 服务端 SSL_CTX 的通用设置
+ * 1. SSL_MODE_RELEASE_BUFFERS: 连接空闲(读写缓冲区为空)时释放约34KB的读写缓冲区
+ *    需要时再从分配器取, 大量空闲长连接不再常驻缓冲区内存
+ * 2. 设置会话ID上下文, 否则开启客户端证书校验时无法恢复会话
+ * 3. cache 不为NULL时安装会话缓存
+ */
+int ssl_server_ctx_init(SSL_CTX *ctx, ssl_session_cache *cache, bool stateless_tickets = true);
+
+} } // namespace
+
+#endif // HTTPS_SUPPORT
+
+#endif // NAKU_SSL_CACHE_H
@@ -0,0 +1,159 @@
+#ifndef NAKU_AFFINITY_H
+#define NAKU_AFFINITY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include <sched.h>
+#include <pthread.h>
+
+namespace naku { namespace base {
+
+/* @brief CPU亲和性, NUMA节点拓扑和线程命名相关的辅助函数, 拓扑信息读取自 sysfs */
+class affinity
+{
+public:
+    /*
+     * @brief 解析内核的 cpulist 格式, 例如 "0-3,8,10-11"
+     * @return 成功返回0, 格式错误返回-1
+     */
+    static int parse_cpulist(const std::string &s, std::vector<int> &cpus)
+    {
+        std::size_t pos = 0;
+
+        cpus.clear();
+        while (pos < s.size() && s[pos] != '\n')
+        {
+            int lo, hi;
+            char *end;
+
+            lo = hi = ::strtol(s.c_str() + pos, &end, 10);
+            if (end == s.c_str() + pos)
+                return -1;
+
+            if (*end == '-')
+            {
+                const char *p = end + 1;
+                hi = ::strtol(p, &end, 10);
+                if (end == p || hi < lo)
+                    return -1;
+            }
+
+            for (int c = lo; c <= hi; c++)
+                cpus.push_back(c);
+
+            pos = end - s.c_str();
+            if (pos < s.size() && s[pos] == ',')
+                pos++;
+        }
+
+        return 0;
+    }
+
+    /* @brief 读取 sysfs 中 cpulist 格式的文件, 文件不存在时返回-1 */
+    static int read_cpulist(const std::string &path, std::vector<int> &cpus)
+    {
+        std::string line;
+        std::ifstream in(path);
+
+        cpus.clear();
+        if (!in)
+            return -1;
+
+        std::getline(in, line);
+        return parse_cpulist(line, cpus);
+    }
+
+    /* @brief 被 isolcpus 隔离的CPU, 这些CPU通常留给专用任务, 不应放置工作线程 */
+    static std::vector<int> isolated_cpus(void)
+    {
+        std::vector<int> cpus;
+        read_cpulist("/sys/devices/system/cpu/isolated", cpus);
+        return cpus;
+    }
+
+    /* @brief NUMA节点上的CPU, 没有NUMA支持时节点0视为包含所有在线CPU */
+    static int node_cpus(int node, std::vector<int> &cpus)
+    {
+        if (read_cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpus) == 0)
+            return 0;
+
+        if (node == 0)
+            return read_cpulist("/sys/devices/system/cpu/online", cpus);
+
+        return -1;
+    }
+
+    /* @brief 当前进程允许运行的CPU(受 taskset/cgroup cpuset 限制) */
+    static std::vector<int> allowed_cpus(void)
+    {
+        cpu_set_t set;
+        std::vector<int> cpus;
+
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof(set), &set) == -1)
+            return cpus;
+
+        for (int c = 0; c < CPU_SETSIZE; c++)
+        {
+            if (CPU_ISSET(c, &set))
+                cpus.push_back(c);
+        }
+
+        return cpus;
+    }
+
+    /*
+     * @brief 从 cpus 中去掉进程不允许使用的CPU, 以及(可选的)被隔离的CPU, 保持原有顺序
+     */
+    static std::vector<int> usable(const std::vector<int> &cpus, bool skip_isolated)
+    {
+        std::vector<int> r;
+        std::vector<int> allowed  = allowed_cpus();
+        std::vector<int> isolated = skip_isolated ? isolated_cpus() : std::vector<int>();
+
+        for (int c : cpus)
+        {
+            if (std::find(allowed.begin(), allowed.end(), c) == allowed.end())
+                continue;
+            if (std::find(isolated.begin(), isolated.end(), c) != isolated.end())
+                continue;
+            r.push_back(c);
+        }
+
+        return r;
+    }
+
+    /* @brief 将调用线程绑定到 cpus 上, cpus 为空时不做任何事 */
+    static int bind(const std::vector<int> &cpus)
+    {
+        cpu_set_t set;
+
+        if (cpus.empty())
+            return 0;
+
+        CPU_ZERO(&set);
+        for (int c : cpus)
+        {
+            if (c >= 0 && c < CPU_SETSIZE)
+                CPU_SET(c, &set);
+        }
+
+        errno = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+        return errno == 0 ? 0 : -1;
+    }
+
+    /* @brief 设置调用线程的名字, 在 top -H / perf / gdb 中可见, 超过15个字符会被截断 */
+    static void set_name(const std::string &name)
+    {
+        ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str());
+    }
+};
+
+} } // namespace
+
+#endif // NAKU_AFFINITY_H
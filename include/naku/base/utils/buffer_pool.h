@@ -0,0 +1,144 @@
+#ifndef NAKU_BUFFER_POOL_H
+#define NAKU_BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 每个线程一个的接收缓冲区池, 缓冲区大小固定
+ * 1. 空闲缓冲区串成单链表, 链表指针存放在缓冲区自身中, 取出和放回不分配内存
+ * 2. 只由所属线程访问, 不需要加锁; 在哪个线程释放就放回哪个线程的池, 不要求与取出的线程相同
+ * 3. 空闲缓冲区超过 max_idle 时直接释放, 突发流量过后不会一直占用内存
+ */
+class buffer_pool
+{
+public:
+	static constexpr std::size_t bufsize  = 16384;
+	static constexpr std::size_t max_idle = 256;
+
+public:
+	buffer_pool() : head(nullptr), idle(0), outstanding(0) {}
+
+	~buffer_pool()
+	{
+		while (head) {
+			node *n = head;
+			head = n->next;
+			delete[] reinterpret_cast<char *>(n);
+		}
+	}
+
+	buffer_pool(const buffer_pool &) = delete;
+	buffer_pool &operator=(const buffer_pool &) = delete;
+
+	/* @brief 当前线程的缓冲区池 */
+	static buffer_pool &local(void)
+	{
+		static thread_local buffer_pool pool;
+		return pool;
+	}
+
+	/* @brief 取出一个 bufsize 大小的缓冲区 */
+	char *get(void)
+	{
+		outstanding++;
+
+		if (head == nullptr)
+			return new char[bufsize];
+
+		node *n = head;
+		head = n->next;
+		idle--;
+		return reinterpret_cast<char *>(n);
+	}
+
+	/* @brief 放回由 get() 取出的缓冲区 */
+	void put(char *buf)
+	{
+		outstanding--;
+
+		if (idle >= max_idle) {
+			delete[] buf;
+			return;
+		}
+
+		node *n = reinterpret_cast<node *>(buf);
+		n->next = head;
+		head = n;
+		idle++;
+	}
+
+	/* @brief 空闲的缓冲区数量 */
+	std::size_t idlecount(void) const {return idle;}
+
+	/* @brief 已取出尚未放回的缓冲区数量(由本线程取出或放回的差值, 跨线程放回时可能为负) */
+	int64_t inuse(void) const {return outstanding;}
+
+private:
+	struct node { node *next; };
+
+	node       *head;
+	std::size_t idle;
+	int64_t     outstanding;
+};
+
+/*
+ * @brief 从 buffer_pool 借用的缓冲区, 析构或 release() 时归还, 只能移动不能拷贝
+ *        size() 为缓冲区中有效数据的长度
+ */
+class pooled_buf
+{
+public:
+	pooled_buf() : buf(nullptr), len(0) {}
+	~pooled_buf() {release();}
+
+	pooled_buf(pooled_buf &&o) noexcept : buf(std::exchange(o.buf, nullptr)), len(std::exchange(o.len, 0)) {}
+	pooled_buf &operator=(pooled_buf &&o) noexcept
+	{
+		if (this != &o) {
+			release();
+			buf = std::exchange(o.buf, nullptr);
+			len = std::exchange(o.len, 0);
+		}
+		return *this;
+	}
+
+	pooled_buf(const pooled_buf &) = delete;
+	pooled_buf &operator=(const pooled_buf &) = delete;
+
+	/* @brief 未持有缓冲区时从当前线程的池中借用一个 */
+	char *acquire(void)
+	{
+		if (buf == nullptr)
+			buf = buffer_pool::local().get();
+		return buf;
+	}
+
+	/* @brief 归还缓冲区 */
+	void release(void)
+	{
+		if (buf) {
+			buffer_pool::local().put(buf);
+			buf = nullptr;
+		}
+		len = 0;
+	}
+
+	char *data(void) {return buf;}
+	const char *data(void) const {return buf;}
+	std::size_t size(void) const {return len;}
+	void resize(std::size_t n) {len = n;}
+	static constexpr std::size_t capacity(void) {return buffer_pool::bufsize;}
+	bool empty(void) const {return buf == nullptr;}
+
+private:
+	char       *buf;
+	std::size_t len;
+};
+
+} } // namespace
+
+#endif // NAKU_BUFFER_POOL_H
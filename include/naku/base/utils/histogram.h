@@ -0,0 +1,142 @@
+#ifndef NAKU_HISTOGRAM_H
+#define NAKU_HISTOGRAM_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace naku { namespace base {
+
+/* @brief 直方图的分位数摘要, 单位与记录的值相同 */
+struct latency_summary
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+};
+
+/*
+ * @brief HDR风格的对数线性直方图
+ * 1. 每个2的幂区间再平均分为 2^sub_bits 个桶, 相对误差不超过 1/2^sub_bits (约6%)
+ *    覆盖 0 ~ 2^64 的范围, 共 (64 - sub_bits + 1) * 2^sub_bits 个桶
+ * 2. 只允许一个线程写入(所属的调度线程), 使用 relaxed 的 load + store, 无锁且不产生带锁前缀的指令
+ *    其他线程可随时读取, 读到的各桶计数之间可能有微小的不一致, 不影响分位数统计
+ */
+class histogram
+{
+public:
+	static constexpr int sub_bits = 4;
+	static constexpr int sub_count = 1 << sub_bits;
+	static constexpr int nbuckets = (64 - sub_bits + 1) * sub_count;
+
+public:
+	histogram() : counts(nbuckets) {}
+
+	/* @brief 记录一个值, 只能由写入线程调用 */
+	void record(uint64_t v)
+	{
+		add(counts[index(v)], 1);
+		add(total, 1);
+		add(sum, v);
+		if (v > max.load(std::memory_order_relaxed))
+			max.store(v, std::memory_order_relaxed);
+	}
+
+	/* @brief 将各桶计数累加到 out 中, 用于合并多个线程的直方图 */
+	void load(std::vector<uint64_t> &out, uint64_t &_sum, uint64_t &_max) const
+	{
+		out.resize(nbuckets, 0);
+		for (int i = 0; i < nbuckets; i++)
+			out[i] += counts[i].load(std::memory_order_relaxed);
+
+		_sum += sum.load(std::memory_order_relaxed);
+		if (max.load(std::memory_order_relaxed) > _max)
+			_max = max.load(std::memory_order_relaxed);
+	}
+
+	/* @brief 计算当前直方图的摘要 */
+	latency_summary summary(void) const
+	{
+		uint64_t s = 0, m = 0;
+		std::vector<uint64_t> c;
+
+		load(c, s, m);
+		return summarize(c, s, m);
+	}
+
+	/* @brief 根据合并后的桶计数计算摘要, 分位数取所在桶的上界 */
+	static latency_summary summarize(const std::vector<uint64_t> &c, uint64_t _sum, uint64_t _max)
+	{
+		latency_summary r{0, _sum, 0, 0, 0, 0, _max};
+
+		for (auto n : c)
+			r.count += n;
+
+		r.p50  = quantile(c, r.count, 0.5);
+		r.p90  = quantile(c, r.count, 0.9);
+		r.p99  = quantile(c, r.count, 0.99);
+		r.p999 = quantile(c, r.count, 0.999);
+		return r;
+	}
+
+	/* @brief 值所在的桶 */
+	static int index(uint64_t v)
+	{
+		if (v < (uint64_t)sub_count)
+			return v;
+
+		int e = 63 - __builtin_clzll(v);  /* 最高位 */
+		return ((e - sub_bits + 1) << sub_bits) + ((v >> (e - sub_bits)) & (sub_count - 1));
+	}
+
+	/* @brief 桶的上界 */
+	static uint64_t upper(int idx)
+	{
+		if (idx < sub_count)
+			return idx;
+
+		int e = (idx >> sub_bits) + sub_bits - 1;
+		uint64_t width = 1ULL << (e - sub_bits);
+		uint64_t lower = (1ULL << e) | ((uint64_t)(idx & (sub_count - 1)) << (e - sub_bits));
+		return lower + width - 1;
+	}
+
+private:
+	static void add(std::atomic<uint64_t> &c, uint64_t n)
+	{
+		c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	static uint64_t quantile(const std::vector<uint64_t> &c, uint64_t count, double q)
+	{
+		uint64_t seen = 0;
+		uint64_t rank = (uint64_t)(q * count);
+
+		if (count == 0)
+			return 0;
+
+		for (size_t i = 0; i < c.size(); i++)
+		{
+			seen += c[i];
+			if (seen > rank)
+				return upper(i);
+		}
+
+		return upper(c.size() - 1);
+	}
+
+private:
+	std::vector<std::atomic<uint64_t>> counts;
+	std::atomic<uint64_t> total{0};
+	std::atomic<uint64_t> sum{0};
+	std::atomic<uint64_t> max{0};
+};
+
+} } // namespace
+
+#endif // NAKU_HISTOGRAM_H
@@ -0,0 +1,149 @@
+#ifndef NAKU_INTRUSIVE_QUEUE_H
+#define NAKU_INTRUSIVE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 侵入式FIFO队列, 链表指针是元素自身的成员 Next, 入队出队不分配内存
+ *        一个元素同一时刻只能在一个队列中, 不负责元素的生命周期
+ */
+template <typename T, T *T::*Next>
+class intrusive_queue
+{
+public:
+	intrusive_queue() : head(nullptr), tail(nullptr), n(0) {}
+
+	intrusive_queue(const intrusive_queue &) = delete;
+	intrusive_queue &operator=(const intrusive_queue &) = delete;
+
+	intrusive_queue(intrusive_queue &&o) noexcept :
+		head(std::exchange(o.head, nullptr)), tail(std::exchange(o.tail, nullptr)), n(std::exchange(o.n, 0)) {}
+
+	intrusive_queue &operator=(intrusive_queue &&o) noexcept
+	{
+		head = std::exchange(o.head, nullptr);
+		tail = std::exchange(o.tail, nullptr);
+		n    = std::exchange(o.n, 0);
+		return *this;
+	}
+
+	bool empty(void) const {return head == nullptr;}
+	std::size_t size(void) const {return n;}
+	T *front(void) const {return head;}
+
+	void push_back(T *t)
+	{
+		t->*Next = nullptr;
+		if (tail)
+			tail->*Next = t;
+		else
+			head = t;
+		tail = t;
+		n++;
+	}
+
+	/* @brief 取出队首元素, 队列为空时返回nullptr */
+	T *pop_front(void)
+	{
+		T *t = head;
+
+		if (t == nullptr)
+			return nullptr;
+
+		head = t->*Next;
+		if (head == nullptr)
+			tail = nullptr;
+		t->*Next = nullptr;
+		n--;
+		return t;
+	}
+
+	/* @brief 将 o 中的所有元素按顺序移到队尾, O(1) */
+	void splice(intrusive_queue &o)
+	{
+		if (o.head == nullptr)
+			return;
+
+		if (tail)
+			tail->*Next = o.head;
+		else
+			head = o.head;
+		tail = o.tail;
+		n += o.n;
+
+		o.head = o.tail = nullptr;
+		o.n = 0;
+	}
+
+private:
+	T *head;
+	T *tail;
+	std::size_t n;
+};
+
+/*
+ * @brief 无锁的侵入式队列, 用于多个生产者向一个消费者提交元素
+ * 1. 生产者用CAS把元素压入链表头, 不加锁, 不分配内存
+ * 2. 消费者用 exchange 一次取走全部元素, 反转后按入队顺序移到 out 的队尾
+ *    消费者只整体取走, 不单独弹出元素, 不存在ABA问题
+ */
+template <typename T, T *T::*Next>
+class mpsc_queue
+{
+public:
+	mpsc_queue() : m_head(nullptr), m_size(0) {}
+
+	mpsc_queue(const mpsc_queue &) = delete;
+	mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+	void enqueue(T *t)
+	{
+		T *h = m_head.load(std::memory_order_relaxed);
+
+		/* 先计数再入队, size() 只会暂时偏大不会下溢 */
+		m_size.fetch_add(1, std::memory_order_relaxed);
+		do {
+			t->*Next = h;
+		} while (!m_head.compare_exchange_weak(h, t, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/* @brief 将队列中所有元素按入队顺序移到 out 的队尾 */
+	void take(intrusive_queue<T, Next> &out)
+	{
+		T *t = m_head.exchange(nullptr, std::memory_order_acquire);
+		T *rev = nullptr, *next;
+		std::size_t n = 0;
+
+		if (t == nullptr)
+			return;
+
+		for (; t; t = next, n++)
+		{
+			next = t->*Next;
+			t->*Next = rev;
+			rev = t;
+		}
+		m_size.fetch_sub(n, std::memory_order_relaxed);
+
+		for (; rev; rev = next)
+		{
+			next = rev->*Next;
+			out.push_back(rev);
+		}
+	}
+
+	/* @brief 近似的元素数量, 用于统计 */
+	std::size_t size(void) const {return m_size.load(std::memory_order_relaxed);}
+
+private:
+	std::atomic<T *> m_head;
+	std::atomic<std::size_t> m_size;
+};
+
+} } // namespace
+
+#endif // NAKU_INTRUSIVE_QUEUE_H
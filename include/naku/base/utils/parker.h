@@ -0,0 +1,97 @@
+#ifndef NAKU_PARKER_H
+#define NAKU_PARKER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <naku/base/logger/logger.h>
+
+namespace naku { namespace base {
+
+/* @brief 自旋等待时降低CPU功耗, 并让出超线程的执行资源 */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield" ::: "memory");
+#endif
+}
+
+/*
+ * @brief 调度线程的阻塞/唤醒, 基于eventfd, 不会丢失唤醒
+ * 1. 消费者(调度线程)每轮调度前 reset(), 然后检查任务队列, 没有任务时 park()
+ * 2. 生产者先入队, 再 unpark(); 只有消费者已阻塞时才写eventfd, 其余情况只是一次原子操作
+ * 3. 生产者在消费者检查队列之后入队时, 状态已被置为 NOTIFIED, park() 会立即返回
+ *    eventfd 是计数的, 写入先于读取发生时也不会丢失
+ * 4. reset() 与 unpark() 中的 seq_cst 栅栏保证: 生产者没有看到 reset() 的写入时, 消费者一定能看到入队的任务
+ */
+class parker
+{
+public:
+	enum {RUNNING, PARKED, NOTIFIED};
+
+public:
+	parker() : state(RUNNING), efd(::eventfd(0, EFD_CLOEXEC))
+	{
+		if (efd == -1) {
+			LOG_FATAL << "Create eventfd failed : " << strerror(errno) << std::endl;
+		}
+	}
+	~parker() { ::close(efd); }
+
+	parker(const parker &) = delete;
+	parker &operator=(const parker &) = delete;
+
+	/* @brief 消费者在检查任务队列前调用 */
+	void reset(void)
+	{
+		state.store(RUNNING, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	/* @brief reset() 之后是否有生产者提交过任务, 用于自旋等待 */
+	bool notified(void) const { return state.load(std::memory_order_acquire) == NOTIFIED; }
+
+	/* @brief 阻塞直到 unpark(), reset() 之后已经 unpark() 过则立即返回 */
+	void park(void)
+	{
+		uint64_t v;
+
+		if (state.exchange(PARKED, std::memory_order_seq_cst) == NOTIFIED) {
+			state.store(RUNNING, std::memory_order_relaxed);
+			return;
+		}
+
+		while (::read(efd, &v, sizeof(v)) == -1 && errno == EINTR)
+			;
+	}
+
+	/* @brief 生产者在入队之后调用 */
+	void unpark(void)
+	{
+		uint64_t v = 1;
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (state.load(std::memory_order_relaxed) == NOTIFIED)
+			return;
+
+		if (state.exchange(NOTIFIED, std::memory_order_seq_cst) == PARKED) {
+			while (::write(efd, &v, sizeof(v)) == -1 && errno == EINTR)
+				;
+		}
+	}
+
+private:
+	std::atomic<int> state;
+	int efd;
+};
+
+} } // namespace
+
+#endif // NAKU_PARKER_H
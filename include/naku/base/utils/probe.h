@@ -0,0 +1,40 @@
+#ifndef NAKU_PROBE_H
+#define NAKU_PROBE_H
+
+/*
+ * @brief USDT 静态探针, provider 为 naku, 供 perf/bpftrace 使用, 示例脚本在 tools/bpftrace
+ * 1. 有 <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel) 时启用, 定义 NAKU_NO_USDT 可关闭
+ * 2. 每个探针编译为一条 nop 和 ELF note 中的参数位置说明, 未被追踪时不产生调用和分支, 只有参数的求值
+ *    参数都是已经在寄存器或栈上的整数和指针, 不要传入需要额外计算的表达式
+ * 3. 没有 <sys/sdt.h> 时为空, 参数不求值
+ *
+ * 探针及参数:
+ *   co_create(frame, function, file, line)    创建协程, function/file 为创建协程的协程函数和文件(字符串)
+ *   co_destroy(frame)                         销毁协程帧
+ *   submit(frame, worker)                     协程被提交给编号为 worker 的调度线程
+ *   resume(worker, frame, delay_ns)           调度线程恢复运行协程, delay_ns 为从可运行到被恢复的调度延迟
+ *   suspend(worker, frame, state, run_ns)     协程挂起或结束后 resume 返回, state 为 CO_STATE (结束时为 CO_RUNNING), run_ns 为本次运行时间
+ *   io_wait(frame, fd, events)                协程交给IO线程等待 fd 上的事件
+ *   io_ready(frame, events)                   IO线程分发一个事件(frame 为 epoll_event.data.ptr)
+ *   poll(nevents)                             epoll_wait 返回
+ */
+#if !defined(NAKU_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NAKU_USDT 1
+#endif
+#endif
+
+#ifdef NAKU_USDT
+#define NAKU_PROBE1(name, a1)                 DTRACE_PROBE1(naku, name, a1)
+#define NAKU_PROBE2(name, a1, a2)             DTRACE_PROBE2(naku, name, a1, a2)
+#define NAKU_PROBE3(name, a1, a2, a3)         DTRACE_PROBE3(naku, name, a1, a2, a3)
+#define NAKU_PROBE4(name, a1, a2, a3, a4)     DTRACE_PROBE4(naku, name, a1, a2, a3, a4)
+#else
+#define NAKU_PROBE1(name, a1)                 do {} while (0)
+#define NAKU_PROBE2(name, a1, a2)             do {} while (0)
+#define NAKU_PROBE3(name, a1, a2, a3)         do {} while (0)
+#define NAKU_PROBE4(name, a1, a2, a3, a4)     do {} while (0)
+#endif
+
+#endif // NAKU_PROBE_H
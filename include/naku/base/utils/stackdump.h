@@ -0,0 +1,64 @@
+#ifndef NAKU_STACKDUMP_H
+#define NAKU_STACKDUMP_H
+
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <execinfo.h>
+
+#include <naku/base/logger/logger.h>
+
+namespace naku { namespace base {
+
+/*
+ * @brief 打印另一个线程当前的调用栈
+ * 1. 向目标线程发送 SIGURG, 由目标线程在信号处理函数中 backtrace() 并写到标准输出
+ *    SIGURG 的默认行为是忽略, 没有安装处理函数时误发送也没有影响
+ * 2. 需要以 -rdynamic 链接才能解析出函数名, 否则只有地址, 可用 addr2line 解析
+ */
+class stackdump
+{
+public:
+	/* @brief 安装信号处理函数, 只需调用一次 */
+	static void install(void)
+	{
+		struct sigaction sa;
+		void *frame;
+
+		/* backtrace() 第一次调用时会加载 libgcc, 其中会分配内存, 不能在信号处理函数中进行 */
+		::backtrace(&frame, 1);
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = handler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (::sigaction(SIGURG, &sa, nullptr) == -1) {
+			LOG_ERROR << "Install stack dump handler failed : " << strerror(errno) << std::endl;
+		}
+	}
+
+	/* @brief 让线程 th 打印自己的调用栈, 异步进行 */
+	static int dump(pthread_t th)
+	{
+		return ::pthread_kill(th, SIGURG);
+	}
+
+private:
+	/* @brief backtrace_symbols_fd 不分配内存, 直接写fd */
+	static void handler(int)
+	{
+		void *frames[64];
+		int n, saved = errno;
+
+		n = ::backtrace(frames, 64);
+		::backtrace_symbols_fd(frames, n, STDOUT_FILENO);
+		errno = saved;
+	}
+};
+
+} } // namespace
+
+#endif // NAKU_STACKDUMP_H
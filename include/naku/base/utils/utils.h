@@ -4,14 +4,17 @@
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
 
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 
 class utils
 {
 public:
-    static const long max_threads = 200;
+    static constexpr long max_threads = 200;
 
 public:
     static long cpu_num(void)
@@ -19,18 +22,57 @@ public:
         return sysconf(_SC_NPROCESSORS_ONLN);
     }
 
-    static long thread_num(void)
+    /*
+     * @brief 线程数 = CPU 核心数 * (1 + IO 耗时/CPU 耗时), 不超过 max_threads
+     * @param io_ratio 线程中阻塞(IO)耗时与CPU耗时的比例, 默认为1即2倍核数
+     */
+    static long thread_num(double io_ratio = 1.0)
     {
         auto cpu = cpu_num();
         if (cpu == -1)
             return -1;
 
-        cpu *= 2;
+        cpu = (long)(cpu * (1 + io_ratio) + 0.5);
         if (cpu <= 0 || cpu > max_threads)
             return max_threads;
     
         return cpu;
     }
+
+    /*
+     * @brief 读取线程在 /proc/self/task/<tid>/schedstat 中的调度统计
+     * @param cpu_ns  累计占用CPU的时间
+     * @param wait_ns 累计可运行但在运行队列中等待CPU的时间
+     * @return 成功返回0, 内核未提供时返回-1
+     */
+    static int thread_schedstat(pid_t tid, uint64_t &cpu_ns, uint64_t &wait_ns)
+    {
+        char path[64];
+        unsigned long long c, w;
+        FILE *fp;
+        int n;
+
+        snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", (int)tid);
+        if ((fp = fopen(path, "r")) == nullptr)
+            return -1;
+
+        n = fscanf(fp, "%llu %llu", &c, &w);
+        fclose(fp);
+        if (n != 2)
+            return -1;
+
+        cpu_ns  = c;
+        wait_ns = w;
+        return 0;
+    }
+
+    /* @brief 单调时钟的当前时间(ns), 用于统计延迟, 通过vDSO读取不陷入内核 */
+    static uint64_t now_ns(void)
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
 };
 
 class posit_num
@@ -0,0 +1,158 @@
+#ifndef NAKU_FRAME_H
+#define NAKU_FRAME_H
+
+#include <deque>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include <naku/base/copool/netio_wrap.h>
+#include <naku/base/copool/task.h>
+
+/*
+ * @brief 长度前缀的二进制帧: 固定长度的帧头中有一个整数长度字段, 其后为帧体
+ *        reader 一次 read 读入尽可能多的数据, 从中切出多个帧, 以指向接收缓冲区的 view 交给调用者, 不拷贝
+ *        writer 把多个帧的帧头和帧体组成 iovec, 以一次 sendmsg 发送, 帧体不拷贝
+ *        fd 可以是 tcp 或 uds 的连接
+ */
+namespace naku { namespace frame {
+
+/* @brief 帧头格式 */
+struct format
+{
+    std::size_t header_size = 4;        /* @brief 帧头长度, 不超过16, 长度字段以外的字节由调用者解释(如消息类型) */
+    std::size_t len_offset  = 0;        /* @brief 长度字段在帧头中的偏移 */
+    std::size_t len_size    = 4;        /* @brief 长度字段的字节数: 1, 2, 4, 8 */
+    bool big_endian         = true;     /* @brief 长度字段为网络字节序 */
+    bool len_includes_header = false;   /* @brief 长度字段的值包括帧头 */
+    std::size_t max_frame   = 16 << 20; /* @brief 帧体最大长度, 超过时 reader::next 返回-1, errno 为 EMSGSIZE */
+
+    /* @brief 帧头格式是否合法: len_size 为 1/2/4/8, 长度字段在帧头内, 帧头不超过16字节 */
+    bool valid(void) const
+    {
+        if (len_size != 1 && len_size != 2 && len_size != 4 && len_size != 8)
+            return false;
+
+        return header_size <= 16 && len_offset <= header_size && len_size <= header_size - len_offset;
+    }
+};
+
+/* @brief 指向接收缓冲区中的一个帧, 在下一次 reader::fill() 之前有效 */
+struct view
+{
+    const char *header;   /* @brief 帧头, format::header_size 字节 */
+    const char *data;     /* @brief 帧体 */
+    std::size_t size;     /* @brief 帧体长度 */
+};
+
+class reader
+{
+public:
+    /* @brief 读入数据后更新接收缓冲区的结束位置 */
+    class fill_awaiter : public naku::base::async_read
+    {
+    public:
+        fill_awaiter(reader &r, char *buf, std::size_t len) : naku::base::async_read(r.m_fd, buf, len), m_r(r) {}
+
+        ssize_t await_resume()
+        {
+            ssize_t n = naku::base::async_read::await_resume();
+
+            if (n > 0)
+                m_r.m_end += n;
+            return n;
+        }
+
+    private:
+        reader &m_r;
+    };
+
+    /*
+     * @param fmt     格式不合法(format::valid)时记录错误, next() 总是返回-1, errno 为 EINVAL
+     * @param bufsize 接收缓冲区的初始大小, 帧(帧头加帧体)更大时增长到能容纳该帧
+     */
+    reader(int fd, const format &fmt = format(), std::size_t bufsize = 64 * 1024);
+
+    reader(const reader &) = delete;
+    reader &operator=(const reader &) = delete;
+
+public:
+    /*
+     * @brief 在协程中调用: n = co_await r.fill(), 一次 read 把数据读入接收缓冲区
+     *        返回读到的字节数, 0 为对端关闭, -1 为出错; 之后用 next() 取出已完整的帧
+     *        先把未完整的帧移到缓冲区开头, 之前 next() 返回的 view 失效
+     */
+    fill_awaiter fill(void);
+
+    /*
+     * @brief 取出下一个完整的帧, 不拷贝, f 指向接收缓冲区
+     * @return 1 取到一个帧, 0 缓冲区中没有完整的帧(需要 fill)
+     *         -1 帧体超过 max_frame(EMSGSIZE), 长度不合法(EPROTO)或格式不合法(EINVAL)
+     */
+    int next(view &f);
+
+    /* @brief 缓冲区中尚未被 next() 取走的字节数, 对端关闭时不为0说明最后一个帧不完整 */
+    std::size_t buffered(void) const {return m_end - m_start;}
+
+    int sockfd(void) const {return m_fd;}
+
+private:
+    int m_fd;
+    format m_fmt;
+    bool m_valid;          /* @brief 构造时的格式是否合法, 不合法时 m_fmt 为默认格式, 只用于保证内存访问安全 */
+    std::vector<char> m_buf;
+    std::size_t m_start;   /* @brief 下一个帧的开始位置 */
+    std::size_t m_end;     /* @brief 已读入数据的结束位置 */
+    std::size_t m_need;    /* @brief 下一个帧的总长度(帧头加帧体), 帧头未读完时为帧头长度 */
+};
+
+class writer
+{
+public:
+    /* @param fmt 格式不合法(format::valid)时记录错误, add() 总是返回-1, errno 为 EINVAL */
+    writer(int fd, const format &fmt = format());
+
+    writer(const writer &) = delete;
+    writer &operator=(const writer &) = delete;
+
+public:
+    /*
+     * @brief 添加一个待发送的帧, 帧体不拷贝, 发送完成(flush 返回)前 data 必须有效
+     * @param header 不为NULL时从中拷贝 header_size 字节作为帧头(用于长度字段以外的内容), 再写入长度字段
+     * @return 成功返回0, 帧体超过 max_frame 或长度字段放不下返回-1, errno 为 EMSGSIZE; 格式不合法时 errno 为 EINVAL
+     */
+    int add(const void *data, std::size_t len, const void *header = nullptr);
+
+    /*
+     * @brief 在协程中调用: n = co_await w.flush(), 以 sendmsg 发送所有已添加的帧, 部分发送时继续发送剩余部分
+     * @return 发送的字节数, 出错返回-1, 此时未发送的帧仍保留, 可用 clear() 丢弃
+     */
+    naku::base::task<ssize_t> flush(void);
+
+    /* @brief 尚未发送的帧数据(帧头加帧体)字节数 */
+    std::size_t pending(void) const;
+
+    /* @brief 丢弃所有未发送的帧 */
+    void clear(void);
+
+    int sockfd(void) const {return m_fd;}
+
+private:
+    /* @brief 已发送 n 字节, 跳过已发送完的 iovec, 调整部分发送的 iovec */
+    void consume(std::size_t n);
+
+private:
+    int m_fd;
+    format m_fmt;
+    bool m_valid;
+    std::deque<std::array<char, 16>> m_hdrs;  /* @brief 帧头, deque 添加元素时已有元素的地址不变, iovec 可以直接指向它 */
+    std::vector<iovec> m_iov;
+    std::size_t m_first;   /* @brief 第一个未发送完的 iovec */
+};
+
+}} // namespace
+
+#endif
@@ -2,21 +2,43 @@
 #define NAKU_NAKU_H
 
 #include <memory>
+#include <vector>
+#include <type_traits>
 
 #include <naku/tcp.h>
+#include <naku/uds.h>
+#include <naku/udp.h>
+#include <naku/frame.h>
+#include <naku/stats.h>
 #include <naku/base/copool/copool.h>
 #include <naku/base/copool/netio_task.h>
+#include <naku/base/copool/netio_wrap.h>
+#include <naku/base/copool/task.h>
+#include <naku/base/copool/when.h>
+#include <naku/base/copool/worker_local.h>
 
 namespace naku {
 
 using netio_task = naku::base::netio_task;
+using co_prio = naku::base::CO_PRIO;
+using pool_options = naku::base::pool_options;
+using cancel_token = naku::base::cancel_token;
+
+/* @brief 返回任意类型结果的子协程, 在协程中 co_await 获取结果 */
+template <typename T = void>
+using task = naku::base::task<T>;
+
+/* @brief 每个调度线程一份的数据(分片状态), 在 copool_init 之后创建 */
+template <typename T>
+using worker_local = naku::base::worker_local<T>;
 
 /*
  * @brief 初始化协程池
+ * @param opts 线程数量, CPU/NUMA绑定等配置, 默认不绑定CPU
  */
-static inline void copool_init(void)
+static inline void copool_init(const pool_options &opts = pool_options())
 {
-    naku::base::netco_pool::get_instance().init();
+    naku::base::netco_pool::get_instance().init(opts);
 }
 
 /*
@@ -37,14 +59,157 @@ static inline void copool_shutdown(void)
 
 /*
  * @brief  创建新协程运行
- * @return 返回协程控制句柄
+ * @return 返回协程控制句柄; 超过准入控制的上限时协程不会运行, 返回的 handle_ 为空, errno 为 EAGAIN
+ *         此时协程参数中的资源(如连接)需由调用者释放
  */
 template <typename F, typename... Args>
+    requires (!std::is_same_v<std::decay_t<F>, naku::base::cancel_token>)
 static inline netio_task co_run(F &&f, Args &&...args)
 {
     return naku::base::netco_pool::get_instance().submit(std::forward<F>(f), std::forward<Args>(args)...);
 }
 
+/*
+ * @brief  创建可取消的新协程运行, 其余同 co_run
+ *         token.cancel() 后协程正在等待的IO立即返回 -1, errno 为 ECANCELED, fd 从 epoll 中注销; 之后的IO操作也返回 ECANCELED
+ *         协程中 when_all/when_any 的子协程一起被取消
+ */
+template <typename F, typename... Args>
+static inline netio_task co_run(const cancel_token &token, F &&f, Args &&...args)
+{
+    netio_task t = f(std::forward<Args>(args)...);
+
+    token.attach(t);
+    return naku::base::netco_pool::get_instance().spawn(t);
+}
+
+/*
+ * @brief  以指定优先级创建新协程运行, 其余同 co_run
+ * @param  prio PRIO_HIGH/PRIO_NORMAL/PRIO_LOW, co_run 创建的协程为 PRIO_NORMAL
+ */
+template <typename F, typename... Args>
+static inline netio_task co_run_prio(co_prio prio, F &&f, Args &&...args)
+{
+    netio_task t = f(std::forward<Args>(args)...);
+
+    t.handle_.promise().prio = prio;
+    return naku::base::netco_pool::get_instance().spawn(t);
+}
+
+/*
+ * @brief  在指定的调度线程上创建新协程运行, 协程不会迁移到其他调度线程, 其余同 co_run
+ * @param  worker 调度线程编号, [0, worker_count()); 无效时协程不会运行, 返回的 handle_ 为空, errno 为 EINVAL
+ */
+template <typename F, typename... Args>
+static inline netio_task co_run_on(std::size_t worker, F &&f, Args &&...args)
+{
+    auto &pool = naku::base::netco_pool::get_instance();
+
+    if (worker >= pool.worker_count()) {
+        errno = EINVAL;
+        return {nullptr};
+    }
+
+    return pool.spawn(f(std::forward<Args>(args)...), (long)worker);
+}
+
+/*
+ * @brief  在协程中把请求发给编号为 worker 的调度线程(分片)处理并等待结果: ssize_t r = co_await naku::submit_to(id, f, args...);
+ *         f(args...) 创建的协程在该调度线程上运行, 可以不加锁地访问该分片的 worker_local 数据
+ *         不经过准入控制; 继承当前协程的优先级和取消请求
+ * @return f 协程的返回值; worker 无效时为 -1, errno 为 EINVAL
+ */
+template <typename F, typename... Args>
+static inline naku::base::async_submit_to submit_to(std::size_t worker, F &&f, Args &&...args)
+{
+    return naku::base::async_submit_to(worker, f(std::forward<Args>(args)...));
+}
+
+/* @brief 当前调度线程的编号, 不在调度线程(协程)中时返回-1 */
+static inline long worker_id(void)
+{
+    return naku::base::netco_pool::worker_id();
+}
+
+/* @brief 调度线程数量, 分片模式下即分片数量 */
+static inline std::size_t worker_count(void)
+{
+    return naku::base::netco_pool::get_instance().worker_count();
+}
+
+/*
+ * @brief 打印所有存活协程的状态(调度线程, 状态, 处于该状态的时间, 等待的fd, 创建协程的协程函数), 按时间从长到短排序
+ *        min_age_ms 只打印处于当前状态超过该时间的协程, 如找出等待IO超过10秒的连接: naku::dump_coroutines(std::cerr, 10000);
+ *        也可设置 pool_options.dump_signal, 之后 kill -USR2 <pid> 打印到标准输出
+ */
+static inline void dump_coroutines(std::ostream &out = std::cout, unsigned int min_age_ms = 0)
+{
+    naku::base::netco_pool::get_instance().dump(out, min_age_ms);
+}
+
+/*
+ * @brief  在协程中让出调度线程: co_await naku::yield();
+ *         协程被放回就绪队列末尾, 长时间计算的协程应定期调用, 避免其他协程得不到运行
+ */
+static inline naku::base::async_yield yield(void)
+{
+    return naku::base::async_yield();
+}
+
+/*
+ * @brief  创建新协程运行, 并阻塞等待其结束
+ * @return 返回协程返回值
+ * @note   co_wait(co_run(f)) 中协程可能在 co_wait 标记等待之前就已结束并被销毁,
+ *         co_call 在协程交给调度线程之前就标记等待, 不存在该竞争
+ */
+template <typename F, typename... Args>
+static inline ssize_t co_call(F &&f, Args &&...args)
+{
+    ssize_t n;
+    netio_task t = f(std::forward<Args>(args)...);
+
+    t.handle_.promise().wait = true;
+    naku::base::netco_pool::get_instance().schedule(t);
+
+    t.handle_.promise().sem.acquire();
+    n = t.handle_.promise().ret_status;
+    t.handle_.destroy();
+
+    return n;
+}
+
+/*
+ * @brief  在协程中并行运行多个协程并等待全部结束: auto rets = co_await naku::when_all(f(a), g(b));
+ *         数量不定时先构造好 vector 再传入, GCC 12 不接受 co_await 表达式中的 vector{...} 花括号初始化
+ * @return 各协程的返回值, 顺序与参数相同
+ */
+static inline naku::base::async_when_all when_all(std::vector<netio_task> tasks)
+{
+    return naku::base::async_when_all(std::move(tasks));
+}
+
+template <typename... Tasks>
+static inline naku::base::async_when_all when_all(Tasks... tasks)
+{
+    return naku::base::async_when_all(std::vector<netio_task>{tasks...});
+}
+
+/*
+ * @brief  在协程中并行运行多个协程, 等待第一个结束: auto [idx, ret] = co_await naku::when_any(f(a), f(b));
+ *         其余协程被取消, 下一次等待IO时返回 -1, errno 为 ECANCELED; 可用于对冲请求降低尾延迟
+ * @return {第一个结束的协程的序号, 其返回值}
+ */
+static inline naku::base::async_when_any when_any(std::vector<netio_task> tasks)
+{
+    return naku::base::async_when_any(std::move(tasks));
+}
+
+template <typename... Tasks>
+static inline naku::base::async_when_any when_any(Tasks... tasks)
+{
+    return naku::base::async_when_any(std::vector<netio_task>{tasks...});
+}
+
 /*
  * @brief 等待协程结束
  * @return 返回协程返回值
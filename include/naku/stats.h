@@ -0,0 +1,31 @@
+#ifndef NAKU_STATS_PUBLIC_H
+#define NAKU_STATS_PUBLIC_H
+
+#include <string>
+#include <cstdint>
+
+#include <naku/base/copool/stats.h>
+
+namespace naku { namespace stats {
+
+using pool_snapshot = naku::base::pool_snapshot;
+
+/*
+ * @brief 获取协程池各线程统计计数的快照
+ *        包括每个调度线程及合并后的调度延迟(sched_delay)和IO等待时间(io_wait)的分位数, 单位ns
+ */
+void snapshot(pool_snapshot &snap);
+
+/* @brief 以 Prometheus 文本格式输出协程池的统计计数 */
+std::string prometheus(void);
+
+/*
+ * @brief 在 ip:port 上启动HTTP监听, 对任意请求返回 prometheus() 的内容
+ *        监听和处理请求都作为协程运行在协程池中, 不额外创建线程
+ * @return 成功返回0, 失败返回-1
+ */
+int serve(std::string ip, uint16_t port);
+
+}} // namespace
+
+#endif // NAKU_STATS_PUBLIC_H
@@ -3,8 +3,12 @@
 
 #include <string>
 #include <cstdint>
+#include <cstddef>
 #include <unistd.h>
 
+#include <naku/base/copool/netio_wrap.h>
+#include <naku/base/copool/task.h>
+
 namespace naku { namespace tcp {
 
 class conn
@@ -13,8 +17,23 @@ public:
     explicit conn(int _fd  = -1) : fd(_fd) {}
 
 public:
+    /* @brief 在普通线程中调用, 阻塞直到读写完成 */
     ssize_t read(char *buf, size_t count);
     ssize_t write(char *buf, size_t count);
+
+    /*
+     * @brief 在协程中调用: n = co_await c.co_read(buf, count)
+     *        在协程中调用阻塞的 read/write 会卡住调度线程
+     */
+    naku::base::async_read co_read(char *buf, size_t count) {return {fd, buf, count};}
+    naku::base::async_write co_write(char *buf, size_t count) {return {fd, buf, count};}
+
+    /*
+     * @brief 在协程中调用: n = co_await c.co_read(buf), 数据在 buf.data() 中
+     *        只在有数据可读时借用调度线程共享的缓冲区, 空闲连接不占用缓冲区
+     */
+    naku::base::async_read_pooled co_read(naku::base::pooled_buf &buf) {return {fd, buf};}
+    int sockfd(void) const {return fd;}
     void shutdown(void) {::close(fd);}
 
 private:
@@ -39,6 +58,17 @@ public:
     static int dialto(std::string ip, uint16_t port, conn& c);
 };
 
+/*
+ * @brief 在协程中把两个连接双向对接, 直到两个方向都结束: ssize_t n = co_await naku::tcp::proxy(a, b);
+ * 1. 每个方向一个子协程, 通过自己的管道以 splice 转发(socket -> 管道 -> socket), 数据不经过用户态
+ *    写入方向使用 dup 出的fd, 两个方向可以同时等待同一个连接上的读和写事件
+ * 2. 一个方向读到对端关闭写(FIN)后, 在另一个连接上 shutdown(SHUT_WR), 另一个方向继续转发, 支持半关闭
+ * 3. 任一方向出错时关闭两个连接的读写, 使另一个方向也结束; 可通过取消 token 提前结束
+ * @param pipe_size 每个方向管道的大小(F_SETPIPE_SZ), 0 使用系统默认值(通常64KB), 超过 /proc/sys/fs/pipe-max-size 时使用默认值
+ * @return 两个方向转发的总字节数, 任一方向出错时返回-1; a 和 b 仍由调用者关闭
+ */
+naku::base::task<ssize_t> proxy(conn &a, conn &b, std::size_t pipe_size = 0);
+
 }} // namespace
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef NAKU_UDP_H
+#define NAKU_UDP_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <naku/base/copool/netio_wrap.h>
+
+namespace naku { namespace udp {
+
+/*
+ * @brief 批量收发使用的消息数组
+ *        mmsghdr/iovec/缓冲区/地址/辅助数据在构造时一次性分配, 之后循环使用
+ *        避免每次 recvmmsg/sendmmsg 都分配内存
+ */
+class batch
+{
+public:
+    /* @param n 每批最多消息数量 @param bufsize 每个消息缓冲区大小, 开启GRO时应不小于64KB */
+    batch(unsigned int n, size_t bufsize);
+
+    /* @brief 禁止拷贝, mmsghdr中保存了指向自身成员的指针 */
+    batch(const batch &) = delete;
+    batch &operator=(const batch &) = delete;
+
+public:
+    unsigned int capacity(void) const {return hdrs.size();}
+    size_t bufsize(void) const {return bsize;}
+
+    /* @brief 第i个消息的缓冲区及收到的数据长度 */
+    char *data(unsigned int i) {return &bufs[i * bsize];}
+    size_t len(unsigned int i) const {return hdrs[i].msg_len;}
+
+    /* @brief 第i个消息的来源地址(接收)或目的地址(发送) */
+    sockaddr_in &addr(unsigned int i) {return addrs[i];}
+
+    /* @brief 开启GRO时, 第i个消息由多个分段聚合而成, 返回分段大小, 未聚合返回0 */
+    uint16_t segsize(unsigned int i);
+
+    /* @brief 设置第i个待发送消息的长度, to为NULL时使用connect的对端地址 */
+    void set(unsigned int i, size_t len, const sockaddr_in *to = NULL);
+
+    /* @brief 接收前重置消息头, 内核会修改 msg_namelen/msg_controllen */
+    mmsghdr *recv_msgs(void);
+
+    /* @brief 发送使用的消息头 */
+    mmsghdr *send_msgs(void) {return hdrs.data();}
+
+private:
+    size_t bsize;
+    std::vector<mmsghdr>     hdrs;
+    std::vector<iovec>       iovs;
+    std::vector<char>        bufs;
+    std::vector<sockaddr_in> addrs;
+    std::vector<uint64_t>    ctrls; /* uint64_t 保证 cmsghdr 对齐 */
+};
+
+class conn
+{
+public:
+    /* @brief n 超过容量时不发送, 返回-1, errno 为 EINVAL */
+    class sendmmsg_awaiter : public naku::base::async_sendmmsg
+    {
+    public:
+        sendmmsg_awaiter(int fd, batch &b, unsigned int n) :
+            naku::base::async_sendmmsg(fd, b.send_msgs(), n, 0), m_valid(n <= b.capacity()) {}
+
+        bool await_ready()
+        {
+            return !m_valid || naku::base::async_sendmmsg::await_ready();
+        }
+
+        ssize_t await_resume()
+        {
+            if (!m_valid) {
+                errno = EINVAL;
+                return -1;
+            }
+            return naku::base::async_sendmmsg::await_resume();
+        }
+
+    private:
+        bool m_valid;
+    };
+
+    explicit conn(int _fd  = -1) : fd(_fd) {}
+
+public:
+    /* @brief 创建socket并绑定本地地址, 失败时关闭本次创建的socket */
+    int bind(std::string ip, uint16_t port);
+
+    /* @brief 设置默认对端地址, fd未创建时先创建socket, 失败时关闭本次创建的socket */
+    int connect(std::string ip, uint16_t port);
+
+    /* @brief 一次系统调用收发多个数据报, 返回实际收发的消息数量; sendmmsg(b, n) 的 n 超过 b.capacity() 时返回-1, errno 为 EINVAL */
+    ssize_t recvmmsg(batch &b);
+    ssize_t sendmmsg(batch &b, unsigned int n);
+    ssize_t recvmmsg(mmsghdr *msgs, unsigned int vlen);
+    ssize_t sendmmsg(mmsghdr *msgs, unsigned int vlen);
+
+    /*
+     * @brief 在协程中调用: n = co_await c.co_recvmmsg(b), 不经过 co_call 的跨线程提交和等待
+     *        在协程中调用阻塞的 recvmmsg/sendmmsg 会卡住调度线程
+     */
+    naku::base::async_recvmmsg co_recvmmsg(batch &b) {return {fd, b.recv_msgs(), b.capacity(), 0};}
+    sendmmsg_awaiter co_sendmmsg(batch &b, unsigned int n) {return {fd, b, n};}
+
+    /*
+     * @brief UDP_SEGMENT(GSO): 发送的每个消息由内核按 segsize 切分为多个数据报
+     *        一次系统调用可发送多达64KB, segsize 为0关闭
+     */
+    int set_gso(uint16_t segsize);
+
+    /* @brief UDP_GRO: 接收时内核将同一流的多个数据报聚合为一个消息, 见 batch::segsize */
+    int set_gro(bool on);
+
+    int sockfd(void) const {return fd;}
+    void shutdown(void) {::close(fd); fd = -1;}
+
+private:
+    /* @brief bind/connect 失败时关闭本次创建的socket, 保留 errno */
+    void discard(bool created);
+
+private:
+    int fd;
+};
+
+}} // namespace
+
+#endif
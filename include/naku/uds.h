@@ -0,0 +1,85 @@
+#ifndef NAKU_UDS_H
+#define NAKU_UDS_H
+
+#include <string>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <naku/base/copool/netio_wrap.h>
+
+/*
+ * @brief AF_UNIX 本地套接字, 用于同主机进程间通信(如与本地存储守护进程通信)
+ *        接口与 naku::tcp 保持一致, 使用相同的awaitable
+ *        路径以 '@' 开头时使用 Linux 抽象命名空间, 不在文件系统中创建文件
+ */
+namespace naku { namespace uds {
+
+class conn
+{
+public:
+    explicit conn(int _fd  = -1) : fd(_fd) {}
+
+public:
+    /* @brief 在普通线程中调用, 阻塞直到读写完成 */
+    ssize_t read(char *buf, size_t count);
+    ssize_t write(char *buf, size_t count);
+
+    /*
+     * @brief 在协程中调用: n = co_await c.co_read(buf, count)
+     *        在协程中调用阻塞的 read/write 会卡住调度线程
+     */
+    naku::base::async_read co_read(char *buf, size_t count) {return {fd, buf, count};}
+    naku::base::async_write co_write(char *buf, size_t count) {return {fd, buf, count};}
+
+    /*
+     * @brief 在协程中调用: n = co_await c.co_read(buf), 数据在 buf.data() 中
+     *        只在有数据可读时借用调度线程共享的缓冲区, 空闲连接不占用缓冲区
+     */
+    naku::base::async_read_pooled co_read(naku::base::pooled_buf &buf) {return {fd, buf};}
+
+    /*
+     * @brief 通过 SCM_RIGHTS 将 passfd 传递给对端, 同时发送 buf 中的数据
+     *        count 为0时发送一个字节占位, 因为不携带数据的辅助消息不保证能送达
+     */
+    ssize_t sendfd(int passfd, char *buf, size_t count);
+
+    /*
+     * @brief 接收对端通过 SCM_RIGHTS 传递的fd, 没有收到fd时 passfd 为 -1
+     *        收到的fd已设置 O_CLOEXEC
+     */
+    ssize_t recvfd(int &passfd, char *buf, size_t count);
+
+    int sockfd(void) const {return fd;}
+    void shutdown(void) {::close(fd);}
+
+private:
+    int fd;
+};
+
+class listener
+{
+public:
+    /* @brief type 为 SOCK_STREAM 或 SOCK_SEQPACKET */
+    int listen(std::string path, int type = SOCK_STREAM);
+    int accept(conn& c);
+
+private:
+    std::string path;
+    int type;
+    int listenfd;
+};
+
+class dialer
+{
+public:
+    /*
+     * @brief 连接到 path, 失败返回-1
+     *        对端监听队列已满时 errno 为 EAGAIN, 可稍后重试; path 为空时为 EINVAL, 过长时为 ENAMETOOLONG
+     */
+    static int dialto(std::string path, conn& c, int type = SOCK_STREAM);
+};
+
+}} // namespace
+
+#endif
@@ -1,38 +1,145 @@
 
 #include <naku/base/copool/copool.h>
+#include <naku/base/copool/when.h>
 #include <naku/base/utils/utils.h>
 
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <algorithm>
+
+#include <fcntl.h>
+
 namespace naku { namespace base {
 
-/* @brief 新增IO事件进行监控 */
-int netco_pool::iomul_worker::ioevent_add(netio_task *task, int events)
+thread_local long netco_pool::t_worker_id = -1;
+
+/* @brief 根据配置计算调度线程的放置 */
+void netco_pool::placement(const pool_options &opts, std::vector<std::vector<int>> &place)
+{
+    std::vector<int> cpus;
+
+    place.clear();
+
+    if (!opts.cpus.empty() || (opts.nodes.empty() && opts.pin))
+    {
+        /* 每个位置一个CPU */
+        cpus = affinity::usable(opts.cpus.empty() ? affinity::allowed_cpus() : opts.cpus, opts.skip_isolated);
+        for (int c : cpus)
+            place.push_back({c});
+    }
+    else if (!opts.nodes.empty())
+    {
+        /* 每个位置一个NUMA节点, 节点内由内核调度 */
+        for (int node : opts.nodes)
+        {
+            if (affinity::node_cpus(node, cpus) == -1) {
+                LOG_ERROR << "numa node " << node << " not found" << std::endl;
+                continue;
+            }
+
+            cpus = affinity::usable(cpus, opts.skip_isolated);
+            if (!cpus.empty())
+                place.push_back(cpus);
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    if (place.empty())
+        LOG_ERROR << "no usable cpu for sched workers, running unpinned" << std::endl;
+}
+
+/*
+ * @brief 新增IO事件进行监控
+ *        可取消的协程在取消来源的锁内注册并挂入其等待列表; 已被取消时不注册, 直接以 ECANCELED 交还给所属调度线程
+ */
+int netco_pool::iomul_worker::ioevent_add(netio_task task, int events)
+{
+    auto &p = task.handle_.promise();
+    int ret = 0;
+
+    NAKU_PROBE3(io_wait, task.handle_.address(), p.fd, events);
+    if (!p.cancel)
+        return poll->ioevent_add(p.fd, events, task.handle_.address());
+
+    if (!p.cancel->park(p, [&]() { ret = poll->ioevent_add(p.fd, events, task.handle_.address()); }))
+    {
+        *p.wait_cancelled = true;
+        p.runnable_ts = utils::now_ns();
+        static_cast<sched_worker*>(p.owner)->wakeup(task);
+    }
+
+    return ret;
+}
+
+/* @brief 取消等待IO的协程, 由 cancel_source::request() 在取走协程后调用, 交给IO线程处理 */
+void netco_pool::iomul_worker::cancel(netio_task task)
+{
+    cancel_que->enqueue(&task.handle_.promise());
+    poll->wakeup();
+}
+
+/*
+ * @brief 在IO线程中处理被取消的协程: 从epoll注销fd, 以 ECANCELED 交还给所属调度线程
+ *        与事件回调在同一线程, 注销之前已取出的事件在回调中因协程已不在等待列表而被忽略, 注销之后不会再有该fd的事件
+ */
+void netco_pool::iomul_worker::reap(void)
 {
-    return poll->ioevent_add(task->handle_.promise().fd, events, task);
+    task_list batch;
+    netio_task::promise_type *p;
+
+    cancel_que->take(batch);
+    while ((p = batch.pop_front()) != nullptr)
+    {
+        poll->ioevent_del(p->fd);
+        *p->wait_cancelled = true;
+        p->runnable_ts = utils::now_ns();
+        pool->io_cancels.fetch_add(1, std::memory_order_relaxed);
+        static_cast<sched_worker*>(p->owner)->wakeup(netio_task::from_promise(*p));
+    }
 }
 
 /* @brief 对协程IO事件进行监控, 发生IO事件时修改协程状态 */
-void netco_pool::iomul_worker::running(void)
+void netco_pool::iomul_worker::running(const std::vector<int> &cpus)
 {
-    /* 设置回调函数, 发生事件时, 将协程状态从IOWAIT修改回RUNNING */
+    /* 设置回调函数, 发生事件时, 将协程交还给所属的调度线程, 由调度线程将状态从IOWAIT修改回RUNNING
+     * 不在IO线程中直接修改 run_state, 避免与调度线程产生数据竞争
+     * 可取消的协程已被取消请求取走时忽略该事件, 由 reap() 唤醒
+     */
     auto callback = [](void *ptr) {
-        netio_task *task;
-        task = static_cast<netio_task*>(ptr);
-        if (task) {
-            task->handle_.promise().run_state = CO_RUNNING;
+        netio_task task;
+        if (ptr) {
+            task.handle_ = std::coroutine_handle<netio_task::promise_type>::from_address(ptr);
+            if (task.handle_.promise().cancel && !task.handle_.promise().cancel->unpark(task.handle_.promise()))
+                return;
+            task.handle_.promise().runnable_ts = utils::now_ns();
+            static_cast<sched_worker*>(task.handle_.promise().owner)->wakeup(task);
         }
     };
 
     poll->set_callback(callback);
 
     /* 启动线程, 开始监控事件 */
-    th = std::make_unique<std::thread>([this]() {
+    th = std::make_unique<std::thread>([this, cpus]() {
+        affinity::set_name("naku-io");
+        if (affinity::bind(cpus) == -1)
+            LOG_ERROR << "bind io worker failed: " << strerror(errno) << std::endl;
+
+        /* 忙轮询时不等待, 否则一直阻塞到有IO事件, 或 shutdown 时被 wakeup() 唤醒 */
+        int timeout = pool->options.idle == IDLE_BUSY ? 0 : -1;
+
         while (!pool->terminated)
         {
-            if (poll->ioevent_handle() == -1)
+            if (poll->ioevent_handle(timeout) == -1)
             {
                 LOG_ERROR << "poll thread exit!!!" << std::endl;
                 return ;
             }
+
+            reap();
         }
     });
 }
@@ -46,93 +153,627 @@ void netco_pool::iomul_worker::stop(void)
 
 /* 
 * @brief 对协程进行调度, 销毁运行结束的协程, 处理协程IO事件
-*        这里使用了一个与用户线程交互的任务队列和调度线程独有的任务列表
-*        解决了用户线程提交任务和调度线程遍历任务调度的竞争问题
+*        这里使用了与用户线程/IO线程交互的任务队列和调度线程独有的各优先级就绪队列
+*        解决了用户线程提交任务和调度线程调度的竞争问题
 */
-void netco_pool::sched_worker::running(void)
+void netco_pool::sched_worker::running(std::size_t id, const std::vector<int> &cpus)
 {
-    auto callback = [this]() {
-        netio_task t;
-        std::list<netio_task> task_list;
+    std::promise<void> started;
+    std::future<void> ready = started.get_future();
+
+    auto callback = [this, id, cpus, &started]() {
+        affinity::set_name("naku-sched-" + std::to_string(id));
+        if (affinity::bind(cpus) == -1) {
+            LOG_ERROR << "bind sched worker " << id << " failed: " << strerror(errno) << std::endl;
+        } else if (!cpus.empty()) {
+            /* 绑定后在本线程重新分配, 首次访问使内存落在本线程所在的NUMA节点上
+             * 此时 running 仍在等待, 没有其他线程访问这些数据
+             */
+            task_que  = std::make_unique<task_inbox>();
+            ready_que = std::make_unique<task_inbox>();
+            m_parker  = std::make_unique<parker>();
+            stats     = std::make_unique<sched_stats>();
+            registry  = std::make_unique<coroutine_registry>();
+        }
+
+        stat_set(stats->tid, gettid());
+        t_worker_id = id;
+        started.set_value();
 
         while (!pool->terminated)
         {
-            /* 0. 从任务队列中取任务放到任务列表中, 头插: 新任务优先调度 */
-            while (!task_que->empty())
-            {
-                std::cout << "get task from que" << std::endl;
-                task_que->dequeue(t);
-                task_list.emplace_front(t);
-            }
+            /* 0. 必须在检查队列之前, 之后入队的任务会使 park() 立即返回 */
+            m_parker->reset();
 
-            /* 1. 如果任务列表和任务队列均为空, 没有可调度的协程, 等待新任务 */
-            if (task_list.empty())
+            /* 1. 没有就绪的协程时等待
+             *    空闲超过CoDel目标值说明已没有积压, 退出丢弃状态; 否则协程都在等待IO时无法再更新状态
+             */
+            if (drain() == 0)
             {
-                std::cout << "empty task list" << std::endl;
-                std::unique_lock<std::mutex> lock(*m_cond_lock);
-                m_cond->wait(lock);
+                uint64_t start = utils::now_ns();
+
+                idle();
+                if (shedding.load(std::memory_order_relaxed) &&
+                    utils::now_ns() - start >= pool->options.codel_target_us * 1000ULL)
+                    stop_shedding();
                 continue;
             }
 
-            /* 2. 轮循调度 */
-            rr_sched(task_list);
+            /* 2. 调度一轮后重新取新就绪的协程, 使新就绪的高优先级协程尽快运行 */
+            rr_sched();
         }
     };
 
     th = std::make_unique<std::thread>(callback);
+
+    /* 等待线程完成绑定和初始化, 之后才允许提交任务 */
+    ready.wait();
 }
 
-/* @brief 轮循调度协程 */
-void netco_pool::sched_worker::rr_sched(std::list<netio_task>& task_list)
+/* @brief 没有可运行的协程时, 按 idle_policy 等待新任务或IO事件 */
+void netco_pool::sched_worker::idle(void)
 {
-    for (auto it = task_list.begin(); \
-        ((!pool->terminated) && (it != task_list.end()));)
+    uint64_t start = utils::now_ns();
+    uint64_t max_spin = pool->options.spin_us * 1000ULL;
+
+    switch (pool->options.idle)
     {
-        if (it->handle_.promise().run_state == CO_RUNNING)
-        {
-            /* 恢复协程运行, 协程resume恢复后再次挂起或返回时，resume函数返回 */
-            it->handle_.resume();
+    case IDLE_BUSY:
+        while (!m_parker->notified() && !pool->terminated)
+            cpu_relax();
+        return;
 
-            /* 如果任务需要IO阻塞, 将IO任务交由Epoll监控
-                * 在监控过程中, 该协程不会被调度执行, 直到IO事件发生, 协程状态恢复为RUNNING
-                */
-            if (it->handle_.promise().run_state == CO_IOWAIT)
-            {
-                /* &*it 取到元素的地址 */
-                pool->io_worker->ioevent_add(&(*it), it->handle_.promise().events);
+    case IDLE_SPIN:
+        /* 自旋等到了任务则加倍自旋时间, 否则减半, 范围 [max_spin/16, max_spin] */
+        if (spin_ns == 0)
+            spin_ns = max_spin;
+
+        while (utils::now_ns() - start < spin_ns)
+        {
+            if (m_parker->notified()) {
+                stat_add(stats->spins);
+                spin_ns = std::min(max_spin, spin_ns * 2);
+                return;
             }
-            /* 如果协程结束, 则销毁 */
-            else if (it->handle_.done())
-            {
-                /* @brief 设置协程在结束时挂起, 因为下面还要使用
-                 * 如果结束时不挂起, 则resume返回后handle就已经销毁, 后面不能再使用
-                 * 设置了结束时挂起, 需要手动销毁协程: 调用 destroy()
-                 */
-                /* 如果有人在等待协程结束, 那么不要直接销毁, 交给等待的人销毁 */
-                if (!it->handle_.promise().wait)
-                    it->handle_.destroy();
-                task_list.erase(it++);  /* 传递给erase一个副本, 自身自增 */
-                tasknum--;
+            cpu_relax();
+        }
+
+        spin_ns = std::max(max_spin / 16, spin_ns / 2);
+        start   = utils::now_ns();
+        [[fallthrough]];
+
+    case IDLE_PARK:
+        m_parker->park();
+        stat_add(stats->parks);
+        stat_add(stats->park_ns, utils::now_ns() - start);
+        return;
+    }
+}
+
+/*
+ * @brief 根据一次调度延迟更新CoDel状态
+ *        延迟低于目标值时立即恢复; 持续高于目标值一个间隔后进入丢弃状态, 不再接收新协程
+ *        只丢弃新协程, 已在运行的协程不受影响
+ */
+void netco_pool::sched_worker::codel(uint64_t delay, uint64_t now)
+{
+    if (delay < pool->options.codel_target_us * 1000ULL)
+    {
+        codel_first_above = 0;
+        if (shedding.load(std::memory_order_relaxed))
+            stop_shedding();
+        return;
+    }
+
+    if (codel_first_above == 0)
+    {
+        codel_first_above = now + pool->options.codel_interval_ms * 1000000ULL;
+    }
+    else if (now >= codel_first_above && !shedding.load(std::memory_order_relaxed))
+    {
+        shedding.store(true, std::memory_order_relaxed);
+        pool->overloaded();
+    }
+}
+
+/* @brief 退出CoDel丢弃状态, 之前所有线程都在丢弃时accept被暂停, 需要恢复 */
+void netco_pool::sched_worker::stop_shedding(void)
+{
+    codel_first_above = 0;
+    shedding.store(false, std::memory_order_relaxed);
+    pool->finished();
+}
+
+/* @brief 从提交队列和IO就绪队列取出协程放入各优先级的就绪队列, 返回就绪协程总数 */
+std::size_t netco_pool::sched_worker::drain(void)
+{
+    task_list batch;
+    netio_task::promise_type *p;
+    std::size_t n = 0;
+
+    /* 0. 新提交的协程, 记录所属的调度线程, IO事件发生时交还给本线程, 并登记到本线程的存活协程中 */
+    task_que->take(batch);
+    while ((p = batch.pop_front()) != nullptr)
+    {
+        p->owner = this;
+        registry->add(p);
+        runq[p->prio].push_back(p);
+    }
+
+    /* 1. IO事件已发生的协程恢复为可运行状态 */
+    ready_que->take(batch);
+    while ((p = batch.pop_front()) != nullptr)
+    {
+        p->run_state = CO_RUNNING;
+        runq[p->prio].push_back(p);
+    }
+
+    for (auto &q : runq)
+        n += q.size();
+
+    return n;
+}
+
+/*
+ * @brief 按优先级加权轮循调度一轮
+ * 1. 先运行等待超过 starve_ms 的低优先级队首协程(饥饿保护)
+ * 2. 优先级 i 最多运行 prio_weights[i] 个协程; 份额不顺延给低优先级, 一轮的时间越短, 新就绪的高优先级协程等待越少
+ */
+void netco_pool::sched_worker::rr_sched(void)
+{
+    uint64_t nready = 0;
+    uint64_t now    = utils::now_ns();
+    uint64_t starve = pool->options.starve_ms * 1000000ULL;
+
+    for (int c = PRIO_NUM - 1; c > PRIO_HIGH; c--)
+    {
+        if (!runq[c].empty() && now - runq[c].front()->runnable_ts > starve)
+        {
+            stat_add(stats->starved);
+            run(netio_task::from_promise(*runq[c].pop_front()));
+            nready++;
+        }
+    }
+
+    for (int c = PRIO_HIGH; c < PRIO_NUM; c++)
+    {
+        uint64_t quota = pool->options.prio_weights[c];
+
+        while (quota > 0 && !runq[c].empty() && !pool->terminated)
+        {
+            run(netio_task::from_promise(*runq[c].pop_front()));
+            nready++;
+            quota--;
+        }
+    }
+
+    stat_add(stats->passes);
+    stat_add(stats->resumes, nready);
+    stat_set(stats->ready, nready);
+}
+
+/* @brief 恢复运行一个就绪协程, 并根据其挂起原因交给IO线程监控或销毁 */
+void netco_pool::sched_worker::run(netio_task task)
+{
+    auto &promise = task.handle_.promise();
+    uint64_t now = utils::now_ns();
+
+    /* 统计调度延迟和IO等待时间, 只由本线程写入 */
+    stats->sched_delay.record(now - promise.runnable_ts);
+    stats->prio_delay[promise.prio].record(now - promise.runnable_ts);
+    if (pool->options.codel_target_us)
+        codel(now - promise.runnable_ts, now);
+    if (promise.iowait_ts)
+    {
+        stats->io_wait.record(promise.runnable_ts - promise.iowait_ts);
+        promise.iowait_ts = 0;
+    }
+
+    /* 恢复协程运行, 协程resume恢复后再次挂起或返回时，resume函数返回
+     * 运行期间记录开始时间和协程帧地址, 供看门狗检查
+     */
+    stat_set(stats->current, (uint64_t)task.handle_.address());
+    stat_set(stats->slice_start, now);
+    run_budget::reset(pool->options.run_budget);
+    NAKU_PROBE3(resume, t_worker_id, task.handle_.address(), now - promise.runnable_ts);
+    if (promise.leaf)
+        promise.leaf.resume();
+    else
+        task.handle_.resume();
+    stat_set(stats->slice_start, 0);
+
+    /* 运行协程的时间, 与线程占用的CPU时间比较得到协程中阻塞调用的时间 */
+    uint64_t end = utils::now_ns();
+    stat_add(stats->busy_ns, end - now);
+    promise.state_ts = end;
+    NAKU_PROBE4(suspend, t_worker_id, task.handle_.address(), (int)promise.run_state, end - now);
+
+    /* 如果任务需要IO阻塞, 将IO任务交由Epoll监控
+     * 在监控过程中, 该协程不在任何就绪队列中, 直到IO事件发生, IO线程将其交还给本线程
+     */
+    if (promise.run_state == CO_IOWAIT)
+    {
+        promise.iowait_ts = end;
+        pool->io_worker->ioevent_add(task, promise.events);
+    }
+    /* 协程池已满, 由协程池在有空余容量时再交给IO线程监控 */
+    else if (promise.run_state == CO_THROTTLED)
+    {
+        pool->throttle(task);
+    }
+    /* 协程主动让出, 放回本优先级就绪队列末尾, 重新开始计算调度延迟 */
+    else if (promise.run_state == CO_YIELD)
+    {
+        promise.run_state = CO_RUNNING;
+        stat_add(stats->yields);
+
+        /* 本线程已不参与调度(adapt_ms)时把让出的协程交给参与调度的线程, 使多余的线程尽快空闲 */
+        if (!pool->is_active(this))
+        {
+            tasknum--;
+            if (promise.admitted)
+                admitted--;
+            registry->remove(&promise);
+            pool->schedule(task);
+        }
+        else
+        {
+            promise.runnable_ts = end;
+            runq[promise.prio].push_back(&promise);
+        }
+    }
+    /* 等待子协程结束, 父协程挂起完成后才计入等待; 子协程已全部结束时直接放回就绪队列
+     * arrive() 返回false后最后一个子协程随时可能唤醒父协程, 不能再访问协程帧
+     */
+    else if (promise.run_state == CO_JOIN)
+    {
+        if (promise.waiting->arrive())
+        {
+            promise.run_state = CO_RUNNING;
+            promise.runnable_ts = utils::now_ns();
+            runq[promise.prio].push_back(&promise);
+        }
+    }
+    /* 如果协程结束, 则销毁 */
+    else if (task.handle_.done())
+    {
+        /* @brief 设置协程在结束时挂起, 因为下面还要使用
+         * 如果结束时不挂起, 则resume返回后handle就已经销毁, 后面不能再使用
+         * 设置了结束时挂起, 需要手动销毁协程: 调用 destroy()
+         */
+        /* 如果有人在等待协程结束, 那么不要直接销毁, 交给等待的人销毁
+         * 唤醒等待者之后不能再访问协程帧, 等待者随时可能将其销毁
+         */
+        tasknum--;
+        if (promise.admitted)
+            admitted--;
+        registry->remove(&promise);
+        if (promise.joiner)
+            joined(task);
+        else if (!promise.wait)
+            task.handle_.destroy();
+        else
+            promise.sem.release();
+        pool->finished();
+    }
+    else
+    {
+        /* 协程既未返回co_return, 也未挂起, 但resume结束了 */
+        LOG_FATAL << "internal error : coroutine stop but not return or suspend" << std::endl;
+    }
+}
+
+/* @brief when_all/when_any 的子协程结束: 记录返回值, 需要时唤醒等待的父协程, 然后销毁子协程 */
+void netco_pool::sched_worker::joined(netio_task task)
+{
+    join_state *j   = task.handle_.promise().joiner;
+    std::size_t idx = task.handle_.promise().join_index;
+    ssize_t value   = task.handle_.promise().ret_status;
+
+    if (j->finish(idx, value))
+    {
+        netio_task w = j->waiter;
+
+        w.handle_.promise().runnable_ts = utils::now_ns();
+        static_cast<sched_worker *>(w.handle_.promise().owner)->wakeup(w);
+    }
+
+    /* 子协程的 promise 持有 j 的引用, 销毁后才可能释放 j */
+    task.handle_.destroy();
+}
+
+/*
+ * @brief 看门狗线程, 每 watchdog_ms/2 检查一次各调度线程
+ *        当前协程运行超过 watchdog_ms 未挂起时, 打印协程帧地址, 并让该调度线程打印自己的调用栈
+ *        同一次运行只报告一次
+ */
+void netco_pool::watchdog(void)
+{
+    uint64_t limit = options.watchdog_ms * 1000000ULL;
+    auto period = std::chrono::milliseconds(std::max(1U, options.watchdog_ms / 2));
+    std::vector<uint64_t> reported(sched_workers.size(), 0);
+    std::unique_lock<std::mutex> lock(wd_lock);
+
+    affinity::set_name("naku-watchdog");
+    stackdump::install();
+
+    while (!wd_cond.wait_for(lock, period, [this] {return terminated.load();}))
+    {
+        uint64_t now = utils::now_ns();
+
+        for (std::size_t i = 0; i < sched_workers.size(); i++)
+        {
+            auto &st = sched_workers[i].get_stats();
+            uint64_t start = stat_get(st.slice_start);
+            uint64_t frame = stat_get(st.current);
+
+            /* 读取帧地址期间协程已经换过, 下次再检查 */
+            if (start == 0 || start == reported[i] || start != stat_get(st.slice_start))
                 continue;
-            }
-            else
-            {
-                /* 协程既未返回co_return, 也未挂起, 但resume结束了 */
-                LOG_FATAL << "internal error : coroutine stop but not return or suspend" << std::endl;
-            }
+            if (now < start || now - start < limit)
+                continue;
+
+            reported[i] = start;
+            long_runs.fetch_add(1, std::memory_order_relaxed);
+            LOG_WARN << "coroutine " << (void *)frame << " on naku-sched-" << i << " has been running for "
+                     << (now - start) / 1000000 << " ms without suspending, stack:" << std::endl;
+            stackdump::dump(sched_workers[i].native_handle());
+        }
+    }
+}
+
+/*
+ * @brief 线程数量调整线程, 每 adapt_ms 统计一次所有调度线程
+ * 1. busy 为运行协程的墙钟时间, cpu 和 runq 为从 schedstat 读取的占用CPU的时间和在运行队列中等待CPU的时间
+ *    blocked = busy - cpu - runq 为协程中阻塞调用的时间; 扣除 runq, CPU不够用时等待CPU的时间不会被当成阻塞, 使线程越来越多
+ *    cpu 中也包括调度本身和 IDLE_SPIN/IDLE_BUSY 空转的时间, 比例偏小, 线程数量偏保守
+ * 2. 比例做指数平均后按 utils::thread_num 计算目标数量, 每次最多移动当前数量的1/4(至少1个), 避免抖动
+ * 3. 统计周期内运行协程的时间不足一个线程的1%时协程池基本空闲, 比例没有意义, 不调整
+ * 4. 减少时被移出的线程不再分配新协程, 已有的协程仍在原线程上运行直到结束
+ */
+void netco_pool::adapt(void)
+{
+    std::size_t n = sched_workers.size();
+    std::vector<uint64_t> busy(n, 0), cpu(n, 0), runq(n, 0);
+    uint64_t period_ns = options.adapt_ms * 1000000ULL;
+    auto period = std::chrono::milliseconds(options.adapt_ms);
+    long lo = std::max(1L, options.min_threads);
+    double ratio = -1;
+    std::unique_lock<std::mutex> lock(wd_lock);
+
+    affinity::set_name("naku-adapt");
+
+    /* 内核未开启 CONFIG_SCHED_INFO 时没有 schedstat, 无法区分阻塞和CPU时间, 线程数量保持初始值 */
+    uint64_t c0, q0;
+    if (n > 0 && utils::thread_schedstat(stat_get(sched_workers[0].get_stats().tid), c0, q0) == -1) {
+        LOG_WARN << "/proc/self/task/<tid>/schedstat unavailable, adapt_ms disabled" << std::endl;
+        return;
+    }
+
+    while (!wd_cond.wait_for(lock, period, [this] {return terminated.load();}))
+    {
+        uint64_t dbusy = 0, dcpu = 0, drunq = 0, blocked;
+        double sample;
+
+        for (std::size_t i = 0; i < n; i++)
+        {
+            uint64_t b = stat_get(sched_workers[i].get_stats().busy_ns), c, q;
+
+            if (utils::thread_schedstat(stat_get(sched_workers[i].get_stats().tid), c, q) == -1)
+                continue;
+
+            dbusy += b - busy[i];
+            dcpu  += c - cpu[i];
+            drunq += q - runq[i];
+            busy[i] = b;
+            cpu[i]  = c;
+            runq[i] = q;
+        }
+
+        if (dbusy < period_ns / 100)
+            continue;
+
+        blocked = dbusy > dcpu + drunq ? dbusy - dcpu - drunq : 0;
+        sample  = (double)blocked / std::max(dcpu, (uint64_t)1);
+        ratio   = ratio < 0 ? sample : (ratio * 3 + sample) / 4;
+        io_ratio.store(ratio, std::memory_order_relaxed);
+
+        long target = std::min(std::max(utils::thread_num(ratio), lo), (long)n);
+        long cur    = active.load(std::memory_order_relaxed);
+        long step   = std::max(1L, cur / 4);
+        long next   = cur < target ? std::min(target, cur + step) : std::max(target, cur - step);
+
+        if (next != cur)
+        {
+            std::unique_lock<std::mutex> slock(submit_lock);
+            active.store(next, std::memory_order_relaxed);
         }
+    }
+}
+
+/* @brief dump 中一个协程的状态, 在登记表的锁内复制出来, 锁外排序和输出 */
+struct coroutine_info
+{
+    std::size_t worker;
+    void *frame;
+    const char *state;
+    uint64_t age;
+    int fd;
+    uint32_t events;
+    int prio;
+    std::source_location site;
+};
+
+/*
+ * @brief 打印所有存活协程的状态
+ *        协程的状态由调度线程写入, 这里不加同步地读取, 得到的是近似值; 登记表的锁只保证协程帧不被销毁
+ *        IOWAIT 的协程在IO事件发生后 runnable_ts 晚于挂起时间, 在被调度线程取走前已是 READY
+ */
+void netco_pool::dump(std::ostream &out, unsigned int min_age_ms)
+{
+    static const char *states[] = {"RUNNING", "READY", "IOWAIT", "THROTTLED", "JOIN"};
+    static const char *prios[]  = {"high", "normal", "low"};
+    std::vector<coroutine_info> infos;
+    std::size_t count[5] = {0};
+    uint64_t now = utils::now_ns();
+    uint64_t min_age = min_age_ms * 1000000ULL;
+    char line[256];
+
+    for (std::size_t i = 0; i < sched_workers.size(); i++)
+    {
+        auto &st = sched_workers[i].get_stats();
+        void *current = (void *)stat_get(st.current);
+        uint64_t slice = stat_get(st.slice_start);
+
+        sched_workers[i].get_registry().for_each([&](netio_task::promise_type &p) {
+            int s;
+            uint64_t since;
+            void *frame = netio_task::from_promise(p).handle_.address();
+
+            if (frame == current && slice != 0) {
+                s = 0, since = slice;
+            } else if (p.run_state == CO_IOWAIT) {
+                s = p.runnable_ts > p.state_ts ? 1 : 2;
+                since = s == 1 ? p.runnable_ts : p.state_ts;
+            } else if (p.run_state == CO_THROTTLED) {
+                s = 3, since = p.state_ts;
+            } else if (p.run_state == CO_JOIN) {
+                s = 4, since = p.state_ts;
+            } else {
+                s = 1, since = p.runnable_ts;
+            }
+
+            count[s]++;
+            uint64_t age = now > since ? now - since : 0;
+            if (age >= min_age)
+                infos.push_back({i, frame, states[s], age, p.fd, p.events, p.prio, p.site});
+        });
+    }
+
+    std::sort(infos.begin(), infos.end(),
+              [](const coroutine_info &a, const coroutine_info &b) {return a.age > b.age;});
+
+    snprintf(line, sizeof(line), "%-6s %-18s %-9s %10s %6s %-6s %-6s %s\n",
+             "worker", "frame", "state", "age_ms", "fd", "events", "prio", "site");
+    out << line;
+
+    for (auto &c : infos)
+    {
+        const char *ev = (c.events & EPOLLIN) && (c.events & EPOLLOUT) ? "IN|OUT" :
+                         (c.events & EPOLLOUT) ? "OUT" : "IN";
+
+        snprintf(line, sizeof(line), "%-6zu %-18p %-9s %10.1f %6d %-6s %-6s ",
+                 c.worker, c.frame, c.state, c.age / 1e6, c.fd, ev, prios[c.prio]);
+        out << line << c.site.function_name() << " at " << c.site.file_name() << ":" << c.site.line() << "\n";
+    }
+
+    out << "live " << count[0] + count[1] + count[2] + count[3] + count[4] << ", shown " << infos.size();
+    for (int s = 0; s < 5; s++)
+        out << ", " << states[s] << " " << count[s];
+    out << std::endl;
+}
+
+/*
+ * @brief dump_signal 的信号处理函数写入的管道, 只能使用异步信号安全的函数
+ *        由 naku-dump 线程修改, 信号可能在任意线程处理, 使用无锁的原子变量
+ */
+static std::atomic<int> dump_wfd{-1};
+static_assert(std::atomic<int>::is_always_lock_free, "dump_wfd must be lock free to be used in a signal handler");
+
+static void dump_handler(int)
+{
+    char c = 0;
+    int saved = errno;
+    int fd = dump_wfd.load();
+
+    /* 管道已满时已有未处理的请求, 丢弃本次 */
+    if (fd != -1 && ::write(fd, &c, 1) == -1) {}
+    errno = saved;
+}
+
+/*
+ * @brief 安装 dump_signal 的信号处理函数, 启动 naku-dump 线程
+ *        dump 需要加锁和分配内存, 不能在信号处理函数中进行, 由 naku-dump 线程读到管道中的字节后生成输出
+ */
+void netco_pool::dump_install(void)
+{
+    struct sigaction sa;
 
-        /* 为实现遍历中删除节点, 不在for语句中写自增 */
-        it++;
+    if (::pipe2(dump_pipe, O_CLOEXEC) == -1 || ::fcntl(dump_pipe[1], F_SETFL, O_NONBLOCK) == -1) {
+        LOG_ERROR << "create dump pipe failed : " << strerror(errno) << std::endl;
+        return;
     }
+
+    dump_wfd = dump_pipe[1];
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (::sigaction(options.dump_signal, &sa, nullptr) == -1) {
+        LOG_ERROR << "install dump handler for signal " << options.dump_signal << " failed : " << strerror(errno) << std::endl;
+        return;
+    }
+
+    dump_thread = std::make_unique<std::thread>([this]() {
+        char buf[64];
+        ssize_t n;
+
+        affinity::set_name("naku-dump");
+
+        while (!terminated)
+        {
+            n = ::read(dump_pipe[0], buf, sizeof(buf));
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0 || terminated)
+                break;
+
+            dump(std::cout);
+        }
+
+        /* 之后再收到信号时忽略, 不再写管道; 管道在 shutdown 中等待本线程结束后关闭 */
+        ::signal(options.dump_signal, SIG_IGN);
+        dump_wfd = -1;
+    });
+}
+
+/* @brief 唤醒 naku-dump 线程, 线程看到 terminated 后退出 */
+void netco_pool::dump_wakeup(void)
+{
+    char c = 0;
+
+    if (::write(dump_pipe[1], &c, 1) == -1)
+        LOG_ERROR << "wake up dump thread failed : " << strerror(errno) << std::endl;
 }
 
 /* @brief 等待线程结束 */
 void netco_pool::sched_worker::stop(void)
 {
-    m_cond->notify_all();
+    m_parker->unpark();
     if (th->joinable())
         th->join();
 }
 
+/*
+ * @brief 请求取消: 取走等待列表中的协程交给IO线程唤醒, 再取消以本对象为 parent 的取消来源
+ *        持有本对象的锁时取子取消来源的锁, 子取消来源析构时只取 parent 的锁, 不会死锁
+ */
+void cancel_source::request(void)
+{
+    netio_task::promise_type *p;
+
+    m_requested.store(true, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    while ((p = m_parked) != nullptr)
+    {
+        unlink(*p);
+        netco_pool::get_instance().cancel_io(netio_task::from_promise(*p));
+    }
+
+    for (cancel_source *c = m_children; c; c = c->m_next)
+        c->request();
+}
+
 } } // namespace
\ No newline at end of file
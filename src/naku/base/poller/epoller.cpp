@@ -1,4 +1,5 @@
 #include <naku/base/poller/epoller.h>
+#include <naku/base/utils/probe.h>
 
 namespace naku { namespace base {
 
@@ -46,13 +47,14 @@ int epoller::ioevent_del(int fd)
 }
 
 /* @brief 监控IO事件, 并设置协程运行状态 */
-int epoller::ioevent_handle(void)
+int epoller::ioevent_handle(int timeout)
 {
     int i, n;
+    uint64_t v;
     epoll_event evs[4096];
 
 again:
-    n = epoll_wait(epoll_fd, evs, 4096, 1);
+    n = epoll_wait(epoll_fd, evs, 4096, timeout);
     if (n == -1)
     {
         if (errno == EINTR)
@@ -62,9 +64,22 @@ again:
         return -1;
     }
 
+    NAKU_PROBE1(poll, n);
+    stat_add(stats.wakeups);
+    if (n == 0)
+        stat_add(stats.timeouts);
+    stat_add(stats.events, n);
+
     /* traverse events */
     for (i = 0; i < n; i++)
     {
+        if (evs[i].data.ptr == &wake_fd) {
+            while (::read(wake_fd, &v, sizeof(v)) == -1 && errno == EINTR)
+                ;
+            continue;
+        }
+
+        NAKU_PROBE2(io_ready, evs[i].data.ptr, evs[i].events);
         if (callback) {
             callback(evs[i].data.ptr);
         }
@@ -73,4 +88,13 @@ again:
     return 0;
 }
 
+/* @brief 写eventfd唤醒epoll_wait */
+void epoller::wakeup(void)
+{
+    uint64_t v = 1;
+
+    while (::write(wake_fd, &v, sizeof(v)) == -1 && errno == EINTR)
+        ;
+}
+
 } } // namespace
\ No newline at end of file
@@ -0,0 +1,208 @@
+#ifdef HTTPS_SUPPORT
+
+#include <ctime>
+#include <functional>
+
+#include <naku/base/ssl/ssl_cache.h>
+
+namespace naku { namespace base {
+
+ssl_session_cache::ssl_session_cache(size_t nshards, size_t capacity, long _timeout) :
+	timeout(_timeout), nhits(0), nmisses(0)
+{
+	if (nshards == 0)
+		nshards = 1;
+
+	shard_capacity = (capacity + nshards - 1) / nshards;
+	if (shard_capacity == 0)
+		shard_capacity = 1;
+
+	for (size_t i = 0; i < nshards; i++)
+		shards.emplace_back(std::make_unique<shard>());
+}
+
+ssl_session_cache::~ssl_session_cache()
+{
+	for (auto &s : shards)
+	{
+		for (auto &kv : s->map)
+			SSL_SESSION_free(kv.second.sess);
+	}
+}
+
+int ssl_session_cache::ex_index(void)
+{
+	static int index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+	return index;
+}
+
+int ssl_session_cache::attach(SSL_CTX *ctx, bool stateless_tickets)
+{
+	if (ex_index() < 0 || SSL_CTX_set_ex_data(ctx, ex_index(), this) != 1)
+		return -1;
+
+	/* 不使用 OpenSSL 内部缓存, 仅通过回调存取 */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+	SSL_CTX_sess_set_new_cb(ctx, new_cb);
+	SSL_CTX_sess_set_get_cb(ctx, get_cb);
+	SSL_CTX_sess_set_remove_cb(ctx, remove_cb);
+	SSL_CTX_set_timeout(ctx, timeout);
+
+	/* 关闭无状态票据后, TLS1.3 使用有状态票据, 票据只是会话ID, 会话保存在本缓存中 */
+	if (!stateless_tickets)
+		SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+	return 0;
+}
+
+size_t ssl_session_cache::size(void)
+{
+	size_t n = 0;
+
+	for (auto &s : shards)
+	{
+		std::unique_lock<std::mutex> lock(s->lock);
+		n += s->map.size();
+	}
+
+	return n;
+}
+
+ssl_session_cache::shard &ssl_session_cache::get_shard(const std::string &id)
+{
+	return *shards[std::hash<std::string>{}(id) % shards.size()];
+}
+
+/* @brief 保存会话, 接管调用者持有的一个引用计数 */
+void ssl_session_cache::insert(SSL_SESSION *sess)
+{
+	unsigned int len;
+	const unsigned char *p = SSL_SESSION_get_id(sess, &len);
+	std::string id((const char*)p, len);
+	shard &s = get_shard(id);
+
+	std::unique_lock<std::mutex> lock(s.lock);
+
+	auto it = s.map.find(id);
+	if (it != s.map.end())
+	{
+		SSL_SESSION_free(it->second.sess);
+		s.lru.erase(it->second.lru);
+		s.map.erase(it);
+	}
+
+	/* 分片已满, 淘汰最久未使用的会话 */
+	while (s.map.size() >= shard_capacity)
+	{
+		auto old = s.map.find(s.lru.back());
+		SSL_SESSION_free(old->second.sess);
+		s.map.erase(old);
+		s.lru.pop_back();
+	}
+
+	s.lru.push_front(id);
+	s.map.emplace(std::move(id), entry{sess, s.lru.begin()});
+}
+
+/* @brief 查找会话, 在锁内增加引用计数, 避免返回后被其他线程淘汰释放 */
+SSL_SESSION *ssl_session_cache::lookup(const unsigned char *p, int len)
+{
+	std::string id((const char*)p, len);
+	shard &s = get_shard(id);
+
+	std::unique_lock<std::mutex> lock(s.lock);
+
+	auto it = s.map.find(id);
+	if (it == s.map.end())
+		return NULL;
+
+	/* 过期的会话直接删除 */
+	SSL_SESSION *sess = it->second.sess;
+	if (SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess) < ::time(NULL))
+	{
+		SSL_SESSION_free(sess);
+		s.lru.erase(it->second.lru);
+		s.map.erase(it);
+		return NULL;
+	}
+
+	s.lru.splice(s.lru.begin(), s.lru, it->second.lru);
+	SSL_SESSION_up_ref(sess);
+	return sess;
+}
+
+void ssl_session_cache::remove(SSL_SESSION *sess)
+{
+	unsigned int len;
+	const unsigned char *p = SSL_SESSION_get_id(sess, &len);
+	std::string id((const char*)p, len);
+	shard &s = get_shard(id);
+
+	std::unique_lock<std::mutex> lock(s.lock);
+
+	auto it = s.map.find(id);
+	if (it == s.map.end() || it->second.sess != sess)
+		return;
+
+	SSL_SESSION_free(it->second.sess);
+	s.lru.erase(it->second.lru);
+	s.map.erase(it);
+}
+
+/* @brief 返回1表示缓存接管了该会话的引用计数 */
+int ssl_session_cache::new_cb(SSL *ssl, SSL_SESSION *sess)
+{
+	auto cache = static_cast<ssl_session_cache*>(
+		SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_index()));
+	if (!cache)
+		return 0;
+
+	cache->insert(sess);
+	return 1;
+}
+
+/* @brief lookup 已增加引用计数, *copy 置0, 该引用交给 OpenSSL */
+SSL_SESSION *ssl_session_cache::get_cb(SSL *ssl, const unsigned char *id, int len, int *copy)
+{
+	SSL_SESSION *sess;
+	auto cache = static_cast<ssl_session_cache*>(
+		SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_index()));
+
+	*copy = 0;
+	if (!cache)
+		return NULL;
+
+	sess = cache->lookup(id, len);
+	if (sess)
+		cache->nhits.fetch_add(1, std::memory_order_relaxed);
+	else
+		cache->nmisses.fetch_add(1, std::memory_order_relaxed);
+
+	return sess;
+}
+
+void ssl_session_cache::remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
+{
+	auto cache = static_cast<ssl_session_cache*>(SSL_CTX_get_ex_data(ctx, ex_index()));
+	if (cache)
+		cache->remove(sess);
+}
+
+int ssl_server_ctx_init(SSL_CTX *ctx, ssl_session_cache *cache, bool stateless_tickets)
+{
+	static const unsigned char sid_ctx[] = "naku";
+
+	SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+	if (SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1) != 1)
+		return -1;
+
+	if (cache)
+		return cache->attach(ctx, stateless_tickets);
+
+	return 0;
+}
+
+} } // namespace
+
+#endif // HTTPS_SUPPORT
@@ -0,0 +1,199 @@
+#include <naku/frame.h>
+#include <naku/base/logger/logger.h>
+
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+namespace naku { namespace frame {
+
+static uint64_t load_len(const char *p, std::size_t n, bool big_endian)
+{
+    uint64_t v = 0;
+
+    for (std::size_t i = 0; i < n; i++)
+        v = (v << 8) | (uint8_t)p[big_endian ? i : n - 1 - i];
+
+    return v;
+}
+
+static void store_len(char *p, std::size_t n, bool big_endian, uint64_t v)
+{
+    for (std::size_t i = 0; i < n; i++, v >>= 8)
+        p[big_endian ? n - 1 - i : i] = (char)(v & 0xff);
+}
+
+reader::reader(int fd, const format &fmt, std::size_t bufsize) :
+    m_fd(fd), m_fmt(fmt), m_valid(fmt.valid()), m_start(0), m_end(0)
+{
+    if (!m_valid) {
+        LOG_ERROR << "invalid frame format (header_size " << fmt.header_size << ", len_offset " << fmt.len_offset
+                  << ", len_size " << fmt.len_size << ")" << std::endl;
+        m_fmt = format();
+    }
+
+    m_need = m_fmt.header_size;
+    m_buf.resize(std::max(bufsize, m_fmt.header_size));
+}
+
+/*
+ * @brief 把未完整的帧移到缓冲区开头, 剩余空间用于本次 read
+ *        未完整的帧不超过一个帧的长度, 拷贝量有限; 缓冲区不够容纳这个帧时增长
+ */
+reader::fill_awaiter reader::fill(void)
+{
+    std::size_t n = m_end - m_start;
+
+    if (m_start > 0)
+    {
+        if (n > 0)
+            ::memmove(m_buf.data(), m_buf.data() + m_start, n);
+        m_start = 0;
+        m_end   = n;
+    }
+
+    /* 调用者没有取完已完整的帧时缓冲区可能已满, 长度为0的 read 会被当成对端关闭 */
+    if (m_buf.size() < m_need)
+        m_buf.resize(m_need);
+    else if (m_end == m_buf.size())
+        m_buf.resize(m_buf.size() * 2);
+
+    return fill_awaiter(*this, m_buf.data() + m_end, m_buf.size() - m_end);
+}
+
+int reader::next(view &f)
+{
+    std::size_t avail = m_end - m_start;
+    const char *p = m_buf.data() + m_start;
+    uint64_t len;
+
+    if (!m_valid) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (avail < m_fmt.header_size) {
+        m_need = m_fmt.header_size;
+        return 0;
+    }
+
+    len = load_len(p + m_fmt.len_offset, m_fmt.len_size, m_fmt.big_endian);
+    if (m_fmt.len_includes_header)
+    {
+        if (len < m_fmt.header_size) {
+            errno = EPROTO;
+            return -1;
+        }
+        len -= m_fmt.header_size;
+    }
+
+    if (len > m_fmt.max_frame) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (avail < m_fmt.header_size + len) {
+        m_need = m_fmt.header_size + len;
+        return 0;
+    }
+
+    f.header = p;
+    f.data   = p + m_fmt.header_size;
+    f.size   = len;
+    m_start += m_fmt.header_size + len;
+    m_need   = m_fmt.header_size;
+    return 1;
+}
+
+writer::writer(int fd, const format &fmt) : m_fd(fd), m_fmt(fmt), m_valid(fmt.valid()), m_first(0)
+{
+    if (!m_valid)
+        LOG_ERROR << "invalid frame format (header_size " << fmt.header_size << ", len_offset " << fmt.len_offset
+                  << ", len_size " << fmt.len_size << ")" << std::endl;
+}
+
+int writer::add(const void *data, std::size_t len, const void *header)
+{
+    uint64_t v = len + (m_fmt.len_includes_header ? m_fmt.header_size : 0);
+
+    /* 帧头保存在16字节的槽中, 格式不合法时不能写入 */
+    if (!m_valid) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* 长度字段放不下时同样视为过长 */
+    if (len > m_fmt.max_frame || (m_fmt.len_size < 8 && (v >> (m_fmt.len_size * 8)) != 0)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    auto &h = m_hdrs.emplace_back();
+    if (header)
+        ::memcpy(h.data(), header, m_fmt.header_size);
+    else
+        ::memset(h.data(), 0, m_fmt.header_size);
+    store_len(h.data() + m_fmt.len_offset, m_fmt.len_size, m_fmt.big_endian, v);
+
+    m_iov.push_back({h.data(), m_fmt.header_size});
+    if (len > 0)
+        m_iov.push_back({const_cast<void *>(data), len});
+
+    return 0;
+}
+
+/* @brief 每次 sendmsg 最多 IOV_MAX 个 iovec, 剩余的在下一次发送 */
+naku::base::task<ssize_t> writer::flush(void)
+{
+    ssize_t n, total = 0;
+    msghdr msg;
+
+    while (m_first < m_iov.size())
+    {
+        ::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = &m_iov[m_first];
+        msg.msg_iovlen = std::min<std::size_t>(m_iov.size() - m_first, IOV_MAX);
+
+        n = co_await naku::base::async_sendmsg(m_fd, &msg, 0);
+        if (n == -1)
+            co_return -1;
+
+        total += n;
+        consume(n);
+    }
+
+    clear();
+    co_return total;
+}
+
+std::size_t writer::pending(void) const
+{
+    std::size_t n = 0;
+
+    for (std::size_t i = m_first; i < m_iov.size(); i++)
+        n += m_iov[i].iov_len;
+
+    return n;
+}
+
+void writer::clear(void)
+{
+    m_hdrs.clear();
+    m_iov.clear();
+    m_first = 0;
+}
+
+void writer::consume(std::size_t n)
+{
+    while (m_first < m_iov.size() && n >= m_iov[m_first].iov_len)
+        n -= m_iov[m_first++].iov_len;
+
+    if (n > 0)
+    {
+        m_iov[m_first].iov_base = (char *)m_iov[m_first].iov_base + n;
+        m_iov[m_first].iov_len -= n;
+    }
+}
+
+}} // namespace
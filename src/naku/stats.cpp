@@ -0,0 +1,334 @@
+#include <naku/stats.h>
+#include <naku/naku.h>
+#include <naku/base/copool/netio_wrap.h>
+#include <naku/base/copool/task.h>
+
+#include <cstdio>
+#include <chrono>
+#include <coroutine>
+
+#include <sys/timerfd.h>
+
+namespace naku { namespace stats {
+
+void snapshot(pool_snapshot &snap)
+{
+    naku::base::netco_pool::get_instance().snapshot(snap);
+}
+
+/* @brief 输出一个指标的 HELP 和 TYPE 行 */
+static void metric_head(std::string &out, const char *name, const char *type, const char *help)
+{
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+}
+
+/* @brief 输出每个调度线程一行的指标 */
+template <typename F>
+static void worker_metric(std::string &out, const pool_snapshot &snap, const char *name,
+                          const char *type, const char *help, F &&value)
+{
+    char line[128];
+
+    metric_head(out, name, type, help);
+    for (auto &w : snap.workers)
+    {
+        snprintf(line, sizeof(line), "%s{worker=\"%zu\"} %s\n", name, w.id, value(w).c_str());
+        out += line;
+    }
+}
+
+/* @brief 以 summary 类型输出每个调度线程的延迟分位数, 单位换算为秒 */
+template <typename F>
+static void worker_summary(std::string &out, const pool_snapshot &snap, const char *name,
+                           const char *help, F &&get)
+{
+    char line[160];
+    static const char *quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+
+    metric_head(out, name, "summary", help);
+    for (auto &w : snap.workers)
+    {
+        const naku::base::latency_summary &s = get(w);
+        uint64_t values[] = {s.p50, s.p90, s.p99, s.p999};
+
+        for (int i = 0; i < 4; i++)
+        {
+            snprintf(line, sizeof(line), "%s{worker=\"%zu\",quantile=\"%s\"} %.9f\n",
+                     name, w.id, quantiles[i], values[i] / 1e9);
+            out += line;
+        }
+
+        snprintf(line, sizeof(line), "%s_sum{worker=\"%zu\"} %.9f\n%s_count{worker=\"%zu\"} %lu\n",
+                 name, w.id, s.sum / 1e9, name, w.id, s.count);
+        out += line;
+    }
+}
+
+/* @brief 以 summary 类型输出合并所有调度线程后各优先级的调度延迟 */
+static void prio_summary(std::string &out, const pool_snapshot &snap)
+{
+    char line[160];
+    const char *name = "naku_pool_prio_sched_delay_seconds";
+    static const char *classes[] = {"high", "normal", "low"};
+    static const char *quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+
+    metric_head(out, name, "summary", "Scheduling delay per priority class, merged across workers.");
+    for (int c = 0; c < naku::base::PRIO_NUM; c++)
+    {
+        const naku::base::latency_summary &s = snap.prio_delay[c];
+        uint64_t values[] = {s.p50, s.p90, s.p99, s.p999};
+
+        for (int i = 0; i < 4; i++)
+        {
+            snprintf(line, sizeof(line), "%s{class=\"%s\",quantile=\"%s\"} %.9f\n",
+                     name, classes[c], quantiles[i], values[i] / 1e9);
+            out += line;
+        }
+
+        snprintf(line, sizeof(line), "%s_sum{class=\"%s\"} %.9f\n%s_count{class=\"%s\"} %lu\n",
+                 name, classes[c], s.sum / 1e9, name, classes[c], s.count);
+        out += line;
+    }
+}
+
+static void pool_metric(std::string &out, const char *name, const char *type, const char *help, uint64_t v)
+{
+    metric_head(out, name, type, help);
+    out += name;
+    out += " " + std::to_string(v) + "\n";
+}
+
+std::string prometheus(void)
+{
+    std::string out;
+    pool_snapshot snap;
+    using ws = naku::base::worker_snapshot;
+
+    snapshot(snap);
+
+    worker_metric(out, snap, "naku_worker_live_coroutines", "gauge",
+        "Coroutines owned by the worker that have not finished.",
+        [](const ws &w) {return std::to_string(w.live);});
+    worker_metric(out, snap, "naku_worker_ready_coroutines", "gauge",
+        "Runnable coroutines seen in the last scheduling pass.",
+        [](const ws &w) {return std::to_string(w.ready);});
+    worker_metric(out, snap, "naku_worker_submit_queue_depth", "gauge",
+        "Submitted coroutines not yet picked up by the worker.",
+        [](const ws &w) {return std::to_string(w.submitq);});
+    worker_metric(out, snap, "naku_worker_resumes_total", "counter",
+        "Coroutine resumes performed by the worker.",
+        [](const ws &w) {return std::to_string(w.resumes);});
+    worker_metric(out, snap, "naku_worker_sched_passes_total", "counter",
+        "Round-robin scheduling passes over the task list.",
+        [](const ws &w) {return std::to_string(w.passes);});
+    worker_metric(out, snap, "naku_worker_parks_total", "counter",
+        "Times the worker parked because it had no tasks.",
+        [](const ws &w) {return std::to_string(w.parks);});
+    worker_metric(out, snap, "naku_worker_park_seconds_total", "counter",
+        "Time the worker spent parked.",
+        [](const ws &w) {return std::to_string(w.park_ns / 1e9);});
+    worker_metric(out, snap, "naku_worker_busy_seconds_total", "counter",
+        "Wall time the worker spent running coroutines, including blocking calls made inside them.",
+        [](const ws &w) {return std::to_string(w.busy_ns / 1e9);});
+    worker_metric(out, snap, "naku_worker_active", "gauge",
+        "1 while new coroutines may be placed on the worker (see pool_options::adapt_ms).",
+        [](const ws &w) {return std::to_string(w.active ? 1 : 0);});
+    worker_metric(out, snap, "naku_worker_spin_wakeups_total", "counter",
+        "Times spinning (IDLE_SPIN) found new work before the worker had to park.",
+        [](const ws &w) {return std::to_string(w.spins);});
+
+    worker_metric(out, snap, "naku_worker_shedding", "gauge",
+        "1 while the worker's CoDel state rejects new coroutines.",
+        [](const ws &w) {return std::to_string(w.shedding ? 1 : 0);});
+
+    worker_summary(out, snap, "naku_worker_sched_delay_seconds",
+        "Time from a coroutine becoming runnable (submit or IO event) to rr_sched resuming it.",
+        [](const ws &w) -> const naku::base::latency_summary & {return w.sched_delay;});
+    worker_summary(out, snap, "naku_worker_io_wait_seconds",
+        "Time coroutines spent parked in CO_IOWAIT before their fd became ready.",
+        [](const ws &w) -> const naku::base::latency_summary & {return w.io_wait;});
+
+    worker_metric(out, snap, "naku_worker_starved_total", "counter",
+        "Lower-priority coroutines run ahead of their turn because they waited longer than starve_ms.",
+        [](const ws &w) {return std::to_string(w.starved);});
+    worker_metric(out, snap, "naku_worker_yields_total", "counter",
+        "Coroutines put back on the ready queue by yield() or an exhausted run budget.",
+        [](const ws &w) {return std::to_string(w.yields);});
+
+    prio_summary(out, snap);
+
+    pool_metric(out, "naku_pool_rejected_total", "counter",
+        "Coroutines refused by admission control.", snap.rejected);
+    pool_metric(out, "naku_pool_accept_pauses_total", "counter",
+        "Times accept was paused because the pool was full.", snap.accept_pause);
+    pool_metric(out, "naku_pool_accept_paused", "gauge",
+        "1 while accept is paused.", snap.paused ? 1 : 0);
+    pool_metric(out, "naku_pool_long_runs_total", "counter",
+        "Resumes the watchdog caught running longer than watchdog_ms without suspending.", snap.long_runs);
+    pool_metric(out, "naku_pool_io_cancels_total", "counter",
+        "Coroutines woken with ECANCELED while parked in IO wait; their fd was removed from epoll.", snap.io_cancels);
+
+    pool_metric(out, "naku_pool_active_workers", "gauge",
+        "Workers new coroutines are placed on.", snap.active);
+
+    pool_metric(out, "naku_poller_wakeups_total", "counter",
+        "Returns from epoll_wait.", snap.wakeups);
+    pool_metric(out, "naku_poller_events_total", "counter",
+        "IO events dispatched by the poller; divide by wakeups for events per wakeup.", snap.events);
+    pool_metric(out, "naku_poller_timeouts_total", "counter",
+        "epoll_wait returns without any event.", snap.timeouts);
+
+    return out;
+}
+
+/* @brief 读取一个HTTP请求(不关心内容), 返回统计计数 */
+static naku::netio_task stats_conn(int fd)
+{
+    ssize_t n;
+    size_t  len = 0;
+    char    req[1024];
+
+    /* 读到请求头结束, 或缓冲区满为止 */
+    while (len < sizeof(req) - 1)
+    {
+        n = co_await naku::base::async_read(fd, req + len, sizeof(req) - 1 - len);
+        if (n <= 0) {
+            ::close(fd);
+            co_return -1;
+        }
+
+        len += n;
+        req[len] = '\0';
+        if (::strstr(req, "\r\n\r\n") || ::strstr(req, "\n\n"))
+            break;
+    }
+
+    std::string body = prometheus();
+    std::string resp = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Connection: close\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    for (size_t off = 0; off < resp.size(); off += n)
+    {
+        n = co_await naku::base::async_write(fd, resp.data() + off, resp.size() - off);
+        if (n <= 0)
+            break;
+    }
+
+    ::close(fd);
+    co_return 0;
+}
+
+/* @brief 监听socket本身不可用的错误, 重试不会成功 */
+static bool accept_fatal(int err)
+{
+    return err == EBADF || err == EINVAL || err == ENOTSOCK || err == EOPNOTSUPP || err == EFAULT || err == ECANCELED;
+}
+
+/*
+ * @brief 资源耗尽(EMFILE/ENFILE/ENOBUFS/ENOMEM)时等待一段时间再 accept
+ *        监听socket一直可读, 立即重试会空转; 定时器在启动时创建, fd 耗尽时仍可使用, 创建失败时退化为让出调度线程
+ */
+static naku::base::task<void> accept_backoff(int tfd)
+{
+    uint64_t expirations;
+    itimerspec its = {};
+
+    if (tfd == -1) {
+        co_await naku::yield();
+        co_return;
+    }
+
+    its.it_value.tv_nsec = 100 * 1000 * 1000;
+    if (::timerfd_settime(tfd, 0, &its, nullptr) == -1) {
+        co_await naku::yield();
+        co_return;
+    }
+
+    co_await naku::base::async_read(tfd, (char *)&expirations, sizeof(expirations));
+}
+
+static naku::netio_task stats_server(int listenfd)
+{
+    using clock = std::chrono::steady_clock;
+
+    int tfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    clock::time_point last_log;
+    uint64_t suppressed = 0;
+
+    for (;;)
+    {
+        /* 统计计数在过载时最有用, 不受准入控制限制 */
+        ssize_t fd = co_await naku::base::async_accept(listenfd, NULL, NULL, false);
+        if (fd == -1)
+        {
+            int err = errno;
+
+            if (accept_fatal(err))
+            {
+                LOG_ERROR << "stats server accept failed, stop serving : " << strerror(err) << std::endl;
+                if (tfd != -1)
+                    ::close(tfd);
+                ::close(listenfd);
+                co_return -1;
+            }
+
+            /* 只是这个连接失败(ECONNABORTED, EPROTO 等), 它已从队列中取出, 可以继续 */
+            if (err != EMFILE && err != ENFILE && err != ENOBUFS && err != ENOMEM)
+                continue;
+
+            /* fd 耗尽时每次 accept 都会失败, 每10秒最多记录一次 */
+            auto now = clock::now();
+            if (now - last_log >= std::chrono::seconds(10)) {
+                LOG_WARN << "stats server accept failed, retry later : " << strerror(err)
+                         << " (" << suppressed << " suppressed)" << std::endl;
+                last_log = now;
+                suppressed = 0;
+            } else {
+                suppressed++;
+            }
+
+            co_await accept_backoff(tfd);
+            continue;
+        }
+
+        naku::base::netco_pool::get_instance().schedule(stats_conn((int)fd));
+    }
+
+    co_return 0;
+}
+
+int serve(std::string ip, uint16_t port)
+{
+    int on = 1;
+    int listenfd;
+    uint32_t addr;
+
+    if (::inet_pton(AF_INET, ip.c_str(), &addr) != 1) {
+        return -1;
+    }
+
+    listenfd = naku::base::naku_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listenfd == -1)
+        return -1;
+
+    ::setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (naku::base::naku_listen(listenfd, addr, port) == -1) {
+        ::close(listenfd);
+        return -1;
+    }
+
+    naku::base::netco_pool::get_instance().schedule(stats_server(listenfd));
+    return 0;
+}
+
+}} // namespace
@@ -1,21 +1,22 @@
 #include <naku/tcp.h>
 #include <naku/naku.h>
 #include <naku/base/copool/netio_wrap.h>
+#include <naku/base/copool/when.h>
 
+#include <vector>
 #include <coroutine>
+#include <fcntl.h>
 
 namespace naku { namespace tcp {
 
 ssize_t conn::read(char *buf, size_t count)
 {
     auto func = [this, buf, count](void) -> netio_task {
-        std::cout << "read fd : " << fd << std::endl;
         ssize_t n = co_await naku::base::async_read(fd, buf, count);
-        std::cout << "async read" << n << std::endl;
         co_return n;
     };
 
-    return co_wait(co_run(func));
+    return co_call(func);
 }
 
 ssize_t conn::write(char *buf, size_t count)
@@ -25,7 +26,7 @@ ssize_t conn::write(char *buf, size_t count)
         co_return n;
     };
 
-    return co_wait(co_run(func));
+    return co_call(func);
 }
 
 int listener::listen(std::string ip, uint16_t port)
@@ -55,7 +56,7 @@ int listener::accept(std::string &cliip, uint16_t& cliport, conn& c)
     auto func = [this, &cliip, &cliport](void) -> netio_task {
         int fd;
         sockaddr_in addr;
-        socklen_t   len;
+        socklen_t   len = sizeof(addr);
         char buf[INET_ADDRSTRLEN] = {0};
 
         fd = co_await naku::base::async_accept(listenfd, (sockaddr*)&addr, &len);
@@ -69,12 +70,12 @@ int listener::accept(std::string &cliip, uint16_t& cliport, conn& c)
         co_return fd;
     };
 
-    auto n = co_wait(co_run(func));
+    auto n = co_call(func);
     if (n == -1) {
         return -1;
     }
 
-    std::cout << "accept return fd : " << n << std::endl;
+    naku::base::netco_pool::get_instance().busy_poll(n);
     c = conn(n);
     return 0;
 }
@@ -107,16 +108,100 @@ int dialer::dialto(std::string ip, uint16_t port, conn& c)
             co_return -1;
         }
 
-        co_return 0;
+        co_return fd;
     };
 
-    auto n = co_wait(co_run(func));
+    auto n = co_call(func);
     if (n == -1) {
         return -1;
     }
 
+    naku::base::netco_pool::get_instance().busy_poll(n);
     c = conn(n);
     return 0;
 }
 
+/*
+ * @brief 单向转发 in -> out, out 为本方向 dup 出的fd, 结束时关闭
+ *        每次把管道中的数据全部写出后再读, 管道中最多有一批数据
+ */
+static netio_task splice_half(int in, int out, std::size_t pipe_size)
+{
+    int p[2];
+    ssize_t n = -1, k, left;
+    ssize_t total = 0;
+    std::size_t chunk;
+
+    if (::pipe2(p, O_NONBLOCK | O_CLOEXEC) == -1) {
+        ::shutdown(in, SHUT_RDWR);
+        ::shutdown(out, SHUT_RDWR);
+        ::close(out);
+        co_return -1;
+    }
+
+    if (pipe_size > 0)
+        ::fcntl(p[1], F_SETPIPE_SZ, (int)pipe_size);
+    k = ::fcntl(p[1], F_GETPIPE_SZ);
+    chunk = k > 0 ? k : 65536;
+
+    for (;;)
+    {
+        n = co_await naku::base::async_splice(in, p[1], chunk, in, EPOLLIN);
+        if (n == -1 && errno == EAGAIN)
+            continue;
+        if (n <= 0)
+            break;
+
+        for (left = n; left > 0; left -= k)
+        {
+            k = co_await naku::base::async_splice(p[0], out, left, out, EPOLLOUT);
+            if (k == -1 && errno == EAGAIN)
+                k = 0;
+            else if (k <= 0)
+                break;
+        }
+
+        if (left > 0) {
+            n = -1;
+            break;
+        }
+        total += n;
+    }
+
+    /* 对端关闭写时向另一端传递半关闭; 出错时关闭两个连接的读写, 唤醒另一个方向 */
+    if (n == 0) {
+        ::shutdown(out, SHUT_WR);
+    } else {
+        ::shutdown(in, SHUT_RDWR);
+        ::shutdown(out, SHUT_RDWR);
+    }
+
+    ::close(p[0]);
+    ::close(p[1]);
+    ::close(out);
+    co_return n == 0 ? total : -1;
+}
+
+naku::base::task<ssize_t> proxy(conn &a, conn &b, std::size_t pipe_size)
+{
+    int da, db;
+    std::vector<netio_task> halves;
+
+    if ((da = ::fcntl(a.sockfd(), F_DUPFD_CLOEXEC, 0)) == -1)
+        co_return -1;
+    if ((db = ::fcntl(b.sockfd(), F_DUPFD_CLOEXEC, 0)) == -1) {
+        ::close(da);
+        co_return -1;
+    }
+
+    halves.push_back(splice_half(a.sockfd(), db, pipe_size));
+    halves.push_back(splice_half(b.sockfd(), da, pipe_size));
+
+    std::vector<ssize_t> rets = co_await naku::base::async_when_all(std::move(halves));
+    if (rets.size() != 2 || rets[0] == -1 || rets[1] == -1)
+        co_return -1;
+
+    co_return rets[0] + rets[1];
+}
+
 }} // namespace
\ No newline at end of file
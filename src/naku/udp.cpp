@@ -0,0 +1,198 @@
+#include <naku/udp.h>
+#include <naku/naku.h>
+#include <naku/base/copool/netio_wrap.h>
+
+#include <coroutine>
+
+#include <netinet/udp.h>
+
+namespace naku { namespace udp {
+
+/* @brief 每个消息的辅助数据空间, 用于接收 UDP_GRO 的分段大小 */
+static const size_t ctrl_words = (CMSG_SPACE(sizeof(int)) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+batch::batch(unsigned int n, size_t bufsize) :
+    bsize(bufsize), hdrs(n), iovs(n), bufs(n * bufsize), addrs(n), ctrls(n * ctrl_words)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        iovs[i].iov_base = data(i);
+        iovs[i].iov_len  = bsize;
+    }
+
+    recv_msgs();
+}
+
+mmsghdr *batch::recv_msgs(void)
+{
+    for (unsigned int i = 0; i < hdrs.size(); i++)
+    {
+        msghdr &h = hdrs[i].msg_hdr;
+
+        iovs[i].iov_len   = bsize;
+        h.msg_name        = &addrs[i];
+        h.msg_namelen     = sizeof(sockaddr_in);
+        h.msg_iov         = &iovs[i];
+        h.msg_iovlen      = 1;
+        h.msg_control     = &ctrls[i * ctrl_words];
+        h.msg_controllen  = ctrl_words * sizeof(uint64_t);
+        h.msg_flags       = 0;
+        hdrs[i].msg_len   = 0;
+    }
+
+    return hdrs.data();
+}
+
+void batch::set(unsigned int i, size_t len, const sockaddr_in *to)
+{
+    msghdr &h = hdrs[i].msg_hdr;
+
+    if (to)
+        addrs[i] = *to;
+
+    iovs[i].iov_len  = len;
+    h.msg_name       = to ? &addrs[i] : NULL;
+    h.msg_namelen    = to ? sizeof(sockaddr_in) : 0;
+    h.msg_iov        = &iovs[i];
+    h.msg_iovlen     = 1;
+    h.msg_control    = NULL;
+    h.msg_controllen = 0;
+    h.msg_flags      = 0;
+}
+
+uint16_t batch::segsize(unsigned int i)
+{
+    cmsghdr *cmsg;
+    msghdr  *h = &hdrs[i].msg_hdr;
+
+    for (cmsg = CMSG_FIRSTHDR(h); cmsg != NULL; cmsg = CMSG_NXTHDR(h, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int gso_size;
+            ::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(int));
+            return gso_size;
+        }
+    }
+
+    return 0;
+}
+
+void conn::discard(bool created)
+{
+    int saved = errno;
+
+    /* 只关闭本次创建的socket, 调用者传入或之前创建的保持不变 */
+    if (created)
+        shutdown();
+    errno = saved;
+}
+
+int conn::bind(std::string ip, uint16_t port)
+{
+    int on = 1;
+    sockaddr_in addr;
+
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (::inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+        return -1;
+    }
+
+    bool created = (fd == -1);
+
+    if (created) {
+        fd = naku::base::naku_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (fd == -1)
+            return -1;
+        naku::base::netco_pool::get_instance().busy_poll(fd);
+    }
+
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(fd, (const sockaddr*)&addr, sizeof(addr)) == -1) {
+        discard(created);
+        return -1;
+    }
+
+    return 0;
+}
+
+int conn::connect(std::string ip, uint16_t port)
+{
+    sockaddr_in addr;
+
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (::inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+        return -1;
+    }
+
+    bool created = (fd == -1);
+
+    if (created) {
+        fd = naku::base::naku_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (fd == -1)
+            return -1;
+        naku::base::netco_pool::get_instance().busy_poll(fd);
+    }
+
+    /* UDP 的 connect 只记录对端地址, 不会阻塞 */
+    if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) == -1) {
+        discard(created);
+        return -1;
+    }
+
+    return 0;
+}
+
+ssize_t conn::recvmmsg(mmsghdr *msgs, unsigned int vlen)
+{
+    auto func = [this, msgs, vlen](void) -> netio_task {
+        ssize_t n = co_await naku::base::async_recvmmsg(fd, msgs, vlen, 0);
+        co_return n;
+    };
+
+    return co_call(func);
+}
+
+ssize_t conn::sendmmsg(mmsghdr *msgs, unsigned int vlen)
+{
+    auto func = [this, msgs, vlen](void) -> netio_task {
+        ssize_t n = co_await naku::base::async_sendmmsg(fd, msgs, vlen, 0);
+        co_return n;
+    };
+
+    return co_call(func);
+}
+
+ssize_t conn::recvmmsg(batch &b)
+{
+    return recvmmsg(b.recv_msgs(), b.capacity());
+}
+
+ssize_t conn::sendmmsg(batch &b, unsigned int n)
+{
+    /* 超过容量时内核会读到 mmsghdr 数组之外 */
+    if (n > b.capacity()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return sendmmsg(b.send_msgs(), n);
+}
+
+int conn::set_gso(uint16_t segsize)
+{
+    int val = segsize;
+    return ::setsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val));
+}
+
+int conn::set_gro(bool on)
+{
+    int val = on ? 1 : 0;
+    return ::setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val));
+}
+
+}} // namespace
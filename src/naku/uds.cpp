@@ -0,0 +1,228 @@
+#include <naku/uds.h>
+#include <naku/naku.h>
+#include <naku/base/copool/netio_wrap.h>
+
+#include <coroutine>
+#include <cstddef>
+
+#include <sys/un.h>
+#include <sys/stat.h>
+
+namespace naku { namespace uds {
+
+/* @brief 将路径转换为 sockaddr_un, '@' 开头的路径使用抽象命名空间 */
+static int make_addr(const std::string &path, sockaddr_un *addr, socklen_t *len)
+{
+    if (path.empty()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (path.size() >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    ::memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    ::memcpy(addr->sun_path, path.c_str(), path.size());
+
+    /* 抽象命名空间: sun_path[0] 为 '\0', 长度不包含结尾的 '\0' */
+    if (path[0] == '@') {
+        addr->sun_path[0] = '\0';
+        *len = offsetof(sockaddr_un, sun_path) + path.size();
+    } else {
+        *len = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+    }
+
+    return 0;
+}
+
+ssize_t conn::read(char *buf, size_t count)
+{
+    auto func = [this, buf, count](void) -> netio_task {
+        ssize_t n = co_await naku::base::async_read(fd, buf, count);
+        co_return n;
+    };
+
+    return co_call(func);
+}
+
+ssize_t conn::write(char *buf, size_t count)
+{
+    auto func = [this, buf, count](void) -> netio_task {
+        ssize_t n = co_await naku::base::async_write(fd, buf, count);
+        co_return n;
+    };
+
+    return co_call(func);
+}
+
+ssize_t conn::sendfd(int passfd, char *buf, size_t count)
+{
+    auto func = [this, passfd, buf, count](void) -> netio_task {
+        char   dummy = 0;
+        iovec  iov;
+        msghdr msg;
+        alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(int))];
+        cmsghdr *cmsg;
+
+        iov.iov_base = (count == 0) ? &dummy : buf;
+        iov.iov_len  = (count == 0) ? 1 : count;
+
+        ::memset(&msg, 0, sizeof(msg));
+        ::memset(&ctrl, 0, sizeof(ctrl));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        ::memcpy(CMSG_DATA(cmsg), &passfd, sizeof(int));
+
+        ssize_t n = co_await naku::base::async_sendmsg(fd, &msg, 0);
+        co_return n;
+    };
+
+    return co_call(func);
+}
+
+ssize_t conn::recvfd(int &passfd, char *buf, size_t count)
+{
+    auto func = [this, &passfd, buf, count](void) -> netio_task {
+        char   dummy;
+        iovec  iov;
+        msghdr msg;
+        alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(int) * 4)];
+        cmsghdr *cmsg;
+
+        passfd = -1;
+        iov.iov_base = (count == 0) ? &dummy : buf;
+        iov.iov_len  = (count == 0) ? 1 : count;
+
+        ::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        ssize_t n = co_await naku::base::async_recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1)
+            co_return -1;
+
+        /* 只保留第一个fd, 对端多传的fd需要关闭, 否则会泄漏 */
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            size_t nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < nfds; i++)
+            {
+                int rfd;
+                ::memcpy(&rfd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (passfd == -1)
+                    passfd = rfd;
+                else
+                    ::close(rfd);
+            }
+        }
+
+        co_return (count == 0) ? 0 : n;
+    };
+
+    return co_call(func);
+}
+
+int listener::listen(std::string _path, int _type)
+{
+    int ret;
+    socklen_t len;
+    sockaddr_un addr;
+    struct stat st;
+
+    if (make_addr(_path, &addr, &len) == -1)
+        return -1;
+
+    /* 上次运行残留的socket文件会导致bind失败, 只删除socket类型的文件 */
+    if (_path[0] != '@' && ::stat(_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        ::unlink(_path.c_str());
+
+    listenfd = naku::base::naku_socket(AF_UNIX, _type | SOCK_CLOEXEC, 0);
+    if (listenfd == -1)
+        return -1;
+
+    ret = naku::base::naku_listen(listenfd, (const sockaddr*)&addr, len);
+    if (ret == -1) {
+        ::close(listenfd);
+        return -1;
+    }
+
+    path = _path;
+    type = _type;
+    return 0;
+}
+
+int listener::accept(conn& c)
+{
+    auto func = [this](void) -> netio_task {
+        int fd;
+
+        fd = co_await naku::base::async_accept(listenfd, NULL, NULL);
+        co_return fd;
+    };
+
+    auto n = co_call(func);
+    if (n == -1) {
+        return -1;
+    }
+
+    c = conn(n);
+    return 0;
+}
+
+int dialer::dialto(std::string path, conn& c, int type)
+{
+    socklen_t len;
+    sockaddr_un addr;
+
+    if (make_addr(path, &addr, &len) == -1)
+        return -1;
+
+    /* 协程在调度线程中运行, errno 是线程局部的, 需要带回调用线程(如监听队列已满的 EAGAIN) */
+    int err = 0;
+
+    auto func = [&addr, len, type, &err](void) -> netio_task {
+        int ret;
+        int fd;
+
+        fd = naku::base::naku_socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            err = errno;
+            co_return -1;
+        }
+
+        ret = co_await naku::base::async_connect(fd, (sockaddr*)&addr, len);
+        if (ret == -1) {
+            err = errno;
+            ::close(fd);
+            co_return -1;
+        }
+
+        co_return fd;
+    };
+
+    auto n = co_call(func);
+    if (n == -1) {
+        errno = err;
+        return -1;
+    }
+
+    c = conn(n);
+    return 0;
+}
+
+}} // namespace
@@ -0,0 +1,270 @@
+
+/*
+ * 测试 naku::frame 的编解码: 多个帧往返, 逐字节到达的部分读, 空帧体, len_includes_header,
+ * max_frame(EMSGSIZE), 长度字段放不下, 不合法的格式(EINVAL)
+ */
+
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <naku/naku.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/* @brief 在协程中读一次 */
+static ssize_t fill(naku::frame::reader &r)
+{
+    return naku::co_call([&r]() -> naku::netio_task {
+        ssize_t n = co_await r.fill();
+        co_return n;
+    });
+}
+
+/* @brief 在协程中发送所有已添加的帧 */
+static ssize_t flush(naku::frame::writer &w)
+{
+    return naku::co_call([&w]() -> naku::netio_task {
+        ssize_t n = co_await w.flush();
+        co_return n;
+    });
+}
+
+/* @brief 读出socket中的所有字节 */
+static std::string drain(int fd)
+{
+    char buf[65536];
+    std::string s;
+    ssize_t n;
+
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+        s.append(buf, n);
+
+    return s;
+}
+
+static void test_round_trip(void)
+{
+    int sv[2];
+    naku::frame::format fmt;
+    std::vector<std::string> bodies = {"", "a", std::string(100, 'b'), "", std::string(70000, 'c')};
+
+    fmt.header_size = 6;
+    fmt.len_offset  = 2;
+    fmt.len_size    = 4;
+
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+    int size = 1 << 20;
+    ::setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    naku::frame::writer w(sv[0], fmt);
+    for (std::size_t i = 0; i < bodies.size(); i++)
+    {
+        char hdr[6] = {'T', (char)i};
+        CHECK(w.add(bodies[i].data(), bodies[i].size(), hdr) == 0);
+    }
+
+    std::size_t total = bodies.size() * 6 + 70101;
+    CHECK(w.pending() == total);
+    CHECK(flush(w) == (ssize_t)total);
+    CHECK(w.pending() == 0);
+
+    /* 初始缓冲区很小, 大帧到来时增长 */
+    naku::frame::reader r(sv[1], fmt, 16);
+    naku::frame::view v;
+    std::size_t got = 0;
+
+    while (got < bodies.size())
+    {
+        int rc;
+
+        if (fill(r) <= 0)
+            break;
+        while ((rc = r.next(v)) == 1)
+        {
+            CHECK(v.header[0] == 'T' && v.header[1] == (char)got);
+            CHECK(std::string(v.data, v.size) == bodies[got]);
+            got++;
+        }
+        CHECK(rc == 0);
+    }
+
+    CHECK(got == bodies.size());
+    CHECK(r.buffered() == 0);
+
+    ::close(sv[0]);
+    CHECK(fill(r) == 0);
+    ::close(sv[1]);
+}
+
+static void test_partial(void)
+{
+    int sv[2], out[2];
+    naku::frame::format fmt;
+    std::vector<std::string> bodies = {"hello", "", std::string(300, 'x'), "world"};
+
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, out);
+
+    /* 先编码到 out, 再逐字节写给 reader */
+    naku::frame::writer w(out[0], fmt);
+    for (auto &b : bodies)
+        w.add(b.data(), b.size());
+    flush(w);
+    std::string bytes = drain(out[1]);
+    CHECK(bytes.size() == bodies.size() * 4 + 310);
+
+    naku::frame::reader r(sv[1], fmt, 8);
+    naku::frame::view v;
+    std::size_t got = 0;
+
+    for (std::size_t i = 0; i < bytes.size(); i++)
+    {
+        CHECK(::write(sv[0], &bytes[i], 1) == 1);
+        CHECK(fill(r) == 1);
+
+        while (r.next(v) == 1)
+        {
+            CHECK(got < bodies.size() && std::string(v.data, v.size) == bodies[got]);
+            got++;
+        }
+    }
+
+    CHECK(got == bodies.size());
+    CHECK(r.buffered() == 0);
+
+    ::close(sv[0]);
+    ::close(sv[1]);
+    ::close(out[0]);
+    ::close(out[1]);
+}
+
+static void test_len_includes_header(void)
+{
+    int sv[2];
+    naku::frame::format fmt;
+
+    fmt.header_size = 3;
+    fmt.len_offset  = 1;
+    fmt.len_size    = 2;
+    fmt.big_endian  = false;
+    fmt.len_includes_header = true;
+
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+
+    naku::frame::writer w(sv[0], fmt);
+    CHECK(w.add("abcd", 4) == 0);
+    CHECK(flush(w) == 7);
+
+    /* 长度为 4+3=7, 小端 */
+    std::string bytes = drain(sv[1]);
+    CHECK(bytes == std::string("\x00\x07\x00" "abcd", 7));
+
+    /* 长度小于帧头: EPROTO */
+    CHECK(::write(sv[0], "\x00\x02\x00", 3) == 3);
+    naku::frame::reader r(sv[1], fmt);
+    naku::frame::view v;
+    CHECK(fill(r) == 3);
+    errno = 0;
+    CHECK(r.next(v) == -1 && errno == EPROTO);
+
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+static void test_limits(void)
+{
+    int sv[2];
+    naku::frame::format fmt;
+    std::string big(101, 'x');
+
+    fmt.max_frame = 100;
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+
+    /* 帧体超过 max_frame */
+    naku::frame::writer w(sv[0], fmt);
+    errno = 0;
+    CHECK(w.add(big.data(), big.size()) == -1 && errno == EMSGSIZE);
+    CHECK(w.add(big.data(), 100) == 0);
+    CHECK(w.pending() == 104);
+    w.clear();
+    CHECK(w.pending() == 0);
+
+    /* 收到声明超过 max_frame 的帧头 */
+    CHECK(::write(sv[0], "\x00\x00\x00\x65", 4) == 4);
+    naku::frame::reader r(sv[1], fmt);
+    naku::frame::view v;
+    CHECK(fill(r) == 4);
+    errno = 0;
+    CHECK(r.next(v) == -1 && errno == EMSGSIZE);
+
+    /* 1字节长度字段放不下256 */
+    naku::frame::format small;
+    small.header_size = 1;
+    small.len_size    = 1;
+    naku::frame::writer ws(sv[0], small);
+    errno = 0;
+    CHECK(ws.add(big.data(), 255) == 0);
+    std::string b256(256, 'y');
+    CHECK(ws.add(b256.data(), b256.size()) == -1 && errno == EMSGSIZE);
+
+    /* 包括帧头时 255 字节的帧体也放不下 */
+    small.len_includes_header = true;
+    naku::frame::writer wi(sv[0], small);
+    errno = 0;
+    CHECK(wi.add(b256.data(), 254) == 0);
+    CHECK(wi.add(b256.data(), 255) == -1 && errno == EMSGSIZE);
+
+    ::close(sv[0]);
+    ::close(sv[1]);
+}
+
+static void test_invalid_format(void)
+{
+    naku::frame::format fmt;
+    naku::frame::view v;
+
+    /* 帧头超过16字节 */
+    fmt.header_size = 64;
+    CHECK(!fmt.valid());
+    naku::frame::writer w(-1, fmt);
+    errno = 0;
+    CHECK(w.add("abc", 3) == -1 && errno == EINVAL);
+    CHECK(w.pending() == 0);
+
+    /* 长度字段宽度不合法, 不终止进程 */
+    fmt = naku::frame::format();
+    fmt.len_size = 3;
+    CHECK(!fmt.valid());
+    naku::frame::reader r(-1, fmt);
+    errno = 0;
+    CHECK(r.next(v) == -1 && errno == EINVAL);
+
+    /* 长度字段超出帧头 */
+    fmt = naku::frame::format();
+    fmt.len_offset = 1;
+    CHECK(!fmt.valid());
+    fmt.header_size = 5;
+    CHECK(fmt.valid());
+}
+
+int main()
+{
+    naku::copool_init();
+
+    test_round_trip();
+    test_partial();
+    test_len_includes_header();
+    test_limits();
+    test_invalid_format();
+
+    naku::copool_shutdown();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
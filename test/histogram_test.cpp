@@ -0,0 +1,80 @@
+
+/*
+ * 测试 histogram 的分桶: 桶的上下界包含值, 相对误差不超过 1/sub_count, 分位数摘要
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+#include <naku/base/utils/histogram.h>
+
+using naku::base::histogram;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/* @brief 值 v 落在其桶的范围内, 且桶宽不超过 v/sub_count */
+static void check_value(uint64_t v)
+{
+    int idx = histogram::index(v);
+    uint64_t hi = histogram::upper(idx);
+    uint64_t lo = idx == 0 ? 0 : histogram::upper(idx - 1) + 1;
+
+    CHECK(idx >= 0 && idx < histogram::nbuckets);
+    CHECK(lo <= v && v <= hi);
+    CHECK(hi - lo <= v / histogram::sub_count);
+}
+
+int main()
+{
+    /* 小于 sub_count 的值每个值一个桶 */
+    for (uint64_t v = 0; v < (uint64_t)histogram::sub_count; v++) {
+        CHECK(histogram::index(v) == (int)v);
+        CHECK(histogram::upper(v) == v);
+    }
+
+    /* 每个2的幂附近, 以及最大值 */
+    for (int e = 0; e < 64; e++) {
+        uint64_t p = 1ULL << e;
+        check_value(p);
+        check_value(p - 1);
+        check_value(p + 1);
+        check_value(p + p / 3);
+    }
+    check_value(UINT64_MAX);
+    CHECK(histogram::index(UINT64_MAX) == histogram::nbuckets - 1);
+    CHECK(histogram::upper(histogram::nbuckets - 1) == UINT64_MAX);
+
+    /* 桶编号随值单调不减, 相邻桶首尾相接 */
+    for (int i = 1; i < histogram::nbuckets; i++) {
+        CHECK(histogram::upper(i) > histogram::upper(i - 1));
+        CHECK(histogram::index(histogram::upper(i - 1) + 1) == i);
+    }
+
+    /* 1..10000 均匀分布的摘要 */
+    histogram h;
+    uint64_t sum = 0;
+
+    for (uint64_t v = 1; v <= 10000; v++) {
+        h.record(v);
+        sum += v;
+    }
+
+    naku::base::latency_summary s = h.summary();
+    CHECK(s.count == 10000);
+    CHECK(s.sum == sum);
+    CHECK(s.max == 10000);
+    CHECK(s.p50 >= 5000 && s.p50 <= 5000 + 5000 / histogram::sub_count);
+    CHECK(s.p99 >= 9900 && s.p99 <= 9900 + 9900 / histogram::sub_count);
+    CHECK(s.p50 <= s.p90 && s.p90 <= s.p99 && s.p99 <= s.p999);
+
+    /* 空直方图 */
+    histogram empty;
+    s = empty.summary();
+    CHECK(s.count == 0 && s.p50 == 0 && s.max == 0);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+
+/*
+ * 测试 intrusive_queue 的FIFO顺序和 splice, 以及 mpsc_queue 多个生产者并发入队时不丢失元素, 每个生产者内保持入队顺序
+ */
+
+#include <cstdio>
+#include <vector>
+#include <thread>
+
+#include <naku/base/utils/intrusive_queue.h>
+
+struct node
+{
+    int producer;
+    int seq;
+    node *next;
+};
+
+using queue = naku::base::intrusive_queue<node, &node::next>;
+using inbox = naku::base::mpsc_queue<node, &node::next>;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static void test_fifo(void)
+{
+    node n[6];
+    queue a, b;
+
+    for (int i = 0; i < 6; i++)
+        n[i] = {0, i, nullptr};
+
+    CHECK(a.empty() && a.size() == 0 && a.pop_front() == nullptr);
+
+    for (int i = 0; i < 3; i++)
+        a.push_back(&n[i]);
+    for (int i = 3; i < 6; i++)
+        b.push_back(&n[i]);
+
+    a.splice(b);
+    CHECK(b.empty() && b.size() == 0);
+    CHECK(a.size() == 6 && a.front() == &n[0]);
+
+    for (int i = 0; i < 6; i++)
+        CHECK(a.pop_front() == &n[i]);
+    CHECK(a.empty() && a.pop_front() == nullptr);
+
+    /* splice 空队列, 以及 splice 到空队列 */
+    a.splice(b);
+    CHECK(a.empty());
+    b.push_back(&n[0]);
+    a.splice(b);
+    CHECK(a.size() == 1 && a.pop_front() == &n[0]);
+
+    /* 移动后原队列为空 */
+    a.push_back(&n[1]);
+    queue c(std::move(a));
+    CHECK(a.empty() && c.size() == 1 && c.pop_front() == &n[1]);
+}
+
+static void test_mpsc(void)
+{
+    const int producers = 4, per = 100000;
+    std::vector<node> nodes(producers * per);
+    std::vector<int> last(producers, -1);
+    std::vector<std::thread> threads;
+    inbox in;
+    queue out;
+    long seen = 0;
+
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&, p]() {
+            for (int i = 0; i < per; i++) {
+                node *n = &nodes[p * per + i];
+                *n = {p, i, nullptr};
+                in.enqueue(n);
+            }
+        });
+    }
+
+    /* 消费者与生产者并发取走, 每个生产者的元素按入队顺序出现 */
+    while (seen < (long)nodes.size())
+    {
+        node *n;
+
+        in.take(out);
+        while ((n = out.pop_front()) != nullptr) {
+            CHECK(n->seq == last[n->producer] + 1);
+            last[n->producer] = n->seq;
+            seen++;
+        }
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    in.take(out);
+    CHECK(out.empty());
+    CHECK(in.size() == 0);
+    for (int p = 0; p < producers; p++)
+        CHECK(last[p] == per - 1);
+}
+
+int main()
+{
+    test_fifo();
+    test_mpsc();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}